@@ -1,5 +1,14 @@
 #include "common.h"
+#include <algorithm>
 #include <cstring>
+#include <poll.h>
+
+// Bytes of one serialized Task
+static const size_t TASK_WIRE_SIZE = sizeof(int) * 14;
+
+// Bytes of a serialized Capabilities
+static const size_t CAPABILITIES_WIRE_SIZE =
+    sizeof(int) * 7 + sizeof(uint32_t) * 2 + sizeof(double) * 3 + sizeof(uint64_t) * 3;
 
 std::vector<char> NetworkMessage::serializeMatrix(const Matrix& matrix) {
     std::vector<char> result;
@@ -44,7 +53,7 @@ Matrix NetworkMessage::deserializeMatrix(const std::vector<char>& data) {
 
 std::vector<char> NetworkMessage::serializeTask(const Task& task) {
     std::vector<char> result;
-    size_t size = sizeof(int) * 6;
+    size_t size = TASK_WIRE_SIZE;
     
     result.resize(size);
     char* ptr = result.data();
@@ -60,6 +69,22 @@ std::vector<char> NetworkMessage::serializeTask(const Task& task) {
     std::memcpy(ptr, &task.endCol, sizeof(int));
     ptr += sizeof(int);
     std::memcpy(ptr, &task.matrixSize, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &task.panelA, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &task.panelB, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &task.jobId, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &task.versionA, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &task.versionB, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &task.startK, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &task.endK, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &task.slice, sizeof(int));
     
     return result;
 }
@@ -79,19 +104,415 @@ Task NetworkMessage::deserializeTask(const std::vector<char>& data) {
     std::memcpy(&task.endCol, ptr, sizeof(int));
     ptr += sizeof(int);
     std::memcpy(&task.matrixSize, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&task.panelA, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&task.panelB, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&task.jobId, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&task.versionA, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&task.versionB, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&task.startK, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&task.endK, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&task.slice, ptr, sizeof(int));
     
     return task;
 }
 
+std::vector<char> NetworkMessage::serializeTaskBatch(const std::vector<Task>& tasks) {
+    std::vector<char> result;
+    int count = tasks.size();
+    size_t taskSize = TASK_WIRE_SIZE;
+    
+    result.resize(sizeof(int) + count * taskSize);
+    char* ptr = result.data();
+    
+    std::memcpy(ptr, &count, sizeof(int));
+    ptr += sizeof(int);
+    
+    for (const Task& task : tasks) {
+        std::vector<char> taskData = serializeTask(task);
+        std::memcpy(ptr, taskData.data(), taskSize);
+        ptr += taskSize;
+    }
+    
+    return result;
+}
+
+std::vector<Task> NetworkMessage::deserializeTaskBatch(const std::vector<char>& data) {
+    std::vector<Task> tasks;
+    if (data.size() < sizeof(int)) {
+        return tasks;
+    }
+    
+    const char* ptr = data.data();
+    int count;
+    std::memcpy(&count, ptr, sizeof(int));
+    ptr += sizeof(int);
+    
+    size_t taskSize = TASK_WIRE_SIZE;
+    tasks.reserve(count);
+    for (int i = 0; i < count; i++) {
+        std::vector<char> taskData(ptr, ptr + taskSize);
+        tasks.push_back(deserializeTask(taskData));
+        ptr += taskSize;
+    }
+    
+    return tasks;
+}
+
+std::vector<char> NetworkMessage::serializeCredits(int credits) {
+    std::vector<char> data(sizeof(int));
+    std::memcpy(data.data(), &credits, sizeof(int));
+    return data;
+}
+
+int NetworkMessage::deserializeCredits(const std::vector<char>& data) {
+    // Older clients send an empty TASK_REQUEST, which asks for a single task
+    if (data.size() < sizeof(int)) {
+        return 1;
+    }
+    
+    int credits;
+    std::memcpy(&credits, data.data(), sizeof(int));
+    return credits;
+}
+
+std::vector<char> NetworkMessage::serializeCapabilities(const Capabilities& caps) {
+    std::vector<char> data(CAPABILITIES_WIRE_SIZE);
+    char* ptr = data.data();
+    
+    for (int value : {caps.protocolVersion, caps.cores, caps.simdLevel, caps.numaNodes, caps.prefetchDepth, caps.relayPort,
+                      caps.summaPort}) {
+        std::memcpy(ptr, &value, sizeof(int));
+        ptr += sizeof(int);
+    }
+    for (uint32_t value : {caps.dtypes, caps.codecs}) {
+        std::memcpy(ptr, &value, sizeof(uint32_t));
+        ptr += sizeof(uint32_t);
+    }
+    for (double value : {caps.clockGHz, caps.gflops, caps.memoryGBps}) {
+        std::memcpy(ptr, &value, sizeof(double));
+        ptr += sizeof(double);
+    }
+    for (uint64_t value : {caps.l2Bytes, caps.l3Bytes, caps.memoryBytes}) {
+        std::memcpy(ptr, &value, sizeof(uint64_t));
+        ptr += sizeof(uint64_t);
+    }
+    
+    return data;
+}
+
+Capabilities NetworkMessage::deserializeCapabilities(const std::vector<char>& data) {
+    Capabilities caps;
+    std::memset(&caps, 0, sizeof(caps));
+    
+    // A short HELLO comes from a client we cannot talk to; version 0 says so
+    if (data.size() < CAPABILITIES_WIRE_SIZE) {
+        return caps;
+    }
+    
+    const char* ptr = data.data();
+    for (int* value : {&caps.protocolVersion, &caps.cores, &caps.simdLevel, &caps.numaNodes, &caps.prefetchDepth, &caps.relayPort,
+                       &caps.summaPort}) {
+        std::memcpy(value, ptr, sizeof(int));
+        ptr += sizeof(int);
+    }
+    for (uint32_t* value : {&caps.dtypes, &caps.codecs}) {
+        std::memcpy(value, ptr, sizeof(uint32_t));
+        ptr += sizeof(uint32_t);
+    }
+    for (double* value : {&caps.clockGHz, &caps.gflops, &caps.memoryGBps}) {
+        std::memcpy(value, ptr, sizeof(double));
+        ptr += sizeof(double);
+    }
+    for (uint64_t* value : {&caps.l2Bytes, &caps.l3Bytes, &caps.memoryBytes}) {
+        std::memcpy(value, ptr, sizeof(uint64_t));
+        ptr += sizeof(uint64_t);
+    }
+    
+    return caps;
+}
+
+std::vector<char> NetworkMessage::serializeHelloAck(const HelloAck& ack) {
+    std::vector<char> data(sizeof(int) * 2);
+    std::memcpy(data.data(), &ack.protocolVersion, sizeof(int));
+    std::memcpy(data.data() + sizeof(int), &ack.prefetchDepth, sizeof(int));
+    return data;
+}
+
+HelloAck NetworkMessage::deserializeHelloAck(const std::vector<char>& data) {
+    HelloAck ack = {0, 1};
+    if (data.size() < sizeof(int) * 2) {
+        return ack;
+    }
+    
+    std::memcpy(&ack.protocolVersion, data.data(), sizeof(int));
+    std::memcpy(&ack.prefetchDepth, data.data() + sizeof(int), sizeof(int));
+    return ack;
+}
+
+std::vector<char> NetworkMessage::serializeBroadcastPlan(const BroadcastPlan& plan) {
+    std::vector<char> data;
+    int hostLen = plan.parentHost.size();
+    data.resize(sizeof(int) * 8 + hostLen);
+    char* ptr = data.data();
+    
+    for (int value : {plan.jobId, plan.rowsA, plan.colsA, plan.rowsB, plan.colsB, plan.parentPort, plan.children, hostLen}) {
+        std::memcpy(ptr, &value, sizeof(int));
+        ptr += sizeof(int);
+    }
+    std::memcpy(ptr, plan.parentHost.data(), hostLen);
+    
+    return data;
+}
+
+BroadcastPlan NetworkMessage::deserializeBroadcastPlan(const std::vector<char>& data) {
+    BroadcastPlan plan;
+    const char* ptr = data.data();
+    int hostLen;
+    
+    for (int* value : {&plan.jobId, &plan.rowsA, &plan.colsA, &plan.rowsB, &plan.colsB, &plan.parentPort, &plan.children, &hostLen}) {
+        std::memcpy(value, ptr, sizeof(int));
+        ptr += sizeof(int);
+    }
+    plan.parentHost.assign(ptr, hostLen);
+    
+    return plan;
+}
+
+std::vector<char> NetworkMessage::serializeSummaPlan(const SummaPlan& plan) {
+    size_t size = sizeof(int) * 10;
+    for (const auto& peer : plan.peers) {
+        size += sizeof(int) * 2 + peer.first.size();
+    }
+    std::vector<char> data(size);
+    char* ptr = data.data();
+    
+    int peers = plan.peers.size();
+    for (int value : {plan.jobId, plan.gridRows, plan.gridCols, plan.row, plan.col, plan.blockSize,
+                      plan.m, plan.n, plan.k, peers}) {
+        std::memcpy(ptr, &value, sizeof(int));
+        ptr += sizeof(int);
+    }
+    for (const auto& [host, port] : plan.peers) {
+        int hostLen = host.size();
+        for (int value : {port, hostLen}) {
+            std::memcpy(ptr, &value, sizeof(int));
+            ptr += sizeof(int);
+        }
+        std::memcpy(ptr, host.data(), hostLen);
+        ptr += hostLen;
+    }
+    
+    return data;
+}
+
+SummaPlan NetworkMessage::deserializeSummaPlan(const std::vector<char>& data) {
+    SummaPlan plan = {};
+    if (data.size() < sizeof(int) * 10) {
+        return plan;
+    }
+    const char* ptr = data.data();
+    const char* end = data.data() + data.size();
+    
+    int peers;
+    for (int* value : {&plan.jobId, &plan.gridRows, &plan.gridCols, &plan.row, &plan.col, &plan.blockSize,
+                       &plan.m, &plan.n, &plan.k, &peers}) {
+        std::memcpy(value, ptr, sizeof(int));
+        ptr += sizeof(int);
+    }
+    for (int i = 0; i < peers && end - ptr >= (ptrdiff_t)(sizeof(int) * 2); i++) {
+        int port, hostLen;
+        std::memcpy(&port, ptr, sizeof(int));
+        std::memcpy(&hostLen, ptr + sizeof(int), sizeof(int));
+        ptr += sizeof(int) * 2;
+        if (hostLen < 0 || end - ptr < hostLen) {
+            break;
+        }
+        plan.peers.emplace_back(std::string(ptr, hostLen), port);
+        ptr += hostLen;
+    }
+    
+    return plan;
+}
+
+std::vector<char> NetworkMessage::serializeSummaData(const SummaData& piece) {
+    std::vector<char> data(sizeof(int) * 5 + piece.data.size() * sizeof(double));
+    char* ptr = data.data();
+    
+    for (int value : {piece.jobId, piece.piece, piece.step, piece.rows, piece.cols}) {
+        std::memcpy(ptr, &value, sizeof(int));
+        ptr += sizeof(int);
+    }
+    std::memcpy(ptr, piece.data.data(), piece.data.size() * sizeof(double));
+    
+    return data;
+}
+
+SummaData NetworkMessage::deserializeSummaData(const std::vector<char>& data) {
+    SummaData piece = {0, 0, -1, 0, 0, {}};
+    if (data.size() < sizeof(int) * 5) {
+        return piece;
+    }
+    const char* ptr = data.data();
+    
+    for (int* value : {&piece.jobId, &piece.piece, &piece.step, &piece.rows, &piece.cols}) {
+        std::memcpy(value, ptr, sizeof(int));
+        ptr += sizeof(int);
+    }
+    
+    // A short payload is a broken one; report it as a piece of nothing
+    size_t elements = (size_t)std::max(piece.rows, 0) * std::max(piece.cols, 0);
+    if (data.size() - sizeof(int) * 5 < elements * sizeof(double)) {
+        piece.step = -1;
+        piece.rows = piece.cols = 0;
+        return piece;
+    }
+    piece.data.resize(elements);
+    std::memcpy(piece.data.data(), ptr, elements * sizeof(double));
+    
+    return piece;
+}
+
+std::vector<char> NetworkMessage::serializeOperandChunk(size_t offset, const char* bytes, size_t len) {
+    std::vector<char> data(sizeof(size_t) + len);
+    std::memcpy(data.data(), &offset, sizeof(size_t));
+    std::memcpy(data.data() + sizeof(size_t), bytes, len);
+    return data;
+}
+
+size_t NetworkMessage::deserializeOperandChunk(const std::vector<char>& data, const char*& bytes, size_t& len) {
+    size_t offset = 0;
+    if (data.size() < sizeof(size_t)) {
+        bytes = nullptr;
+        len = 0;
+        return offset;
+    }
+    
+    std::memcpy(&offset, data.data(), sizeof(size_t));
+    bytes = data.data() + sizeof(size_t);
+    len = data.size() - sizeof(size_t);
+    return offset;
+}
+
+std::vector<char> NetworkMessage::serializePanelRequest(const std::vector<PanelKey>& panels) {
+    std::vector<char> data;
+    int count = panels.size();
+    data.resize(sizeof(int) + count * 4 * sizeof(int));
+    char* ptr = data.data();
+    
+    std::memcpy(ptr, &count, sizeof(int));
+    ptr += sizeof(int);
+    for (const PanelKey& panel : panels) {
+        for (int value : {panel.kind, panel.version, panel.index, panel.slice}) {
+            std::memcpy(ptr, &value, sizeof(int));
+            ptr += sizeof(int);
+        }
+    }
+    
+    return data;
+}
+
+std::vector<PanelKey> NetworkMessage::deserializePanelRequest(const std::vector<char>& data) {
+    std::vector<PanelKey> panels;
+    if (data.size() < sizeof(int)) {
+        return panels;
+    }
+    
+    const char* ptr = data.data();
+    int count;
+    std::memcpy(&count, ptr, sizeof(int));
+    ptr += sizeof(int);
+    count = std::min<size_t>(count, (data.size() - sizeof(int)) / (4 * sizeof(int)));
+    
+    for (int i = 0; i < count; i++) {
+        PanelKey panel;
+        for (int* value : {&panel.kind, &panel.version, &panel.index, &panel.slice}) {
+            std::memcpy(value, ptr, sizeof(int));
+            ptr += sizeof(int);
+        }
+        panels.push_back(panel);
+    }
+    
+    return panels;
+}
+
+std::vector<char> NetworkMessage::serializePanel(const PanelKey& key, int start, int end, int depth, const double* rows,
+                                                int stride) {
+    std::vector<char> data;
+    size_t elements = (size_t)(end - start) * depth;
+    data.resize(sizeof(int) * 7 + elements * sizeof(double));
+    char* ptr = data.data();
+    
+    for (int value : {key.kind, key.version, key.index, key.slice, start, end, depth}) {
+        std::memcpy(ptr, &value, sizeof(int));
+        ptr += sizeof(int);
+    }
+    if (stride == depth) {
+        std::memcpy(ptr, rows, elements * sizeof(double));
+    } else {
+        for (int row = start; row < end; row++) {
+            std::memcpy(ptr, rows, depth * sizeof(double));
+            ptr += depth * sizeof(double);
+            rows += stride;
+        }
+    }
+    
+    return data;
+}
+
+Panel NetworkMessage::deserializePanel(const std::vector<char>& data) {
+    Panel panel;
+    const char* ptr = data.data();
+    
+    for (int* value : {&panel.kind, &panel.version, &panel.index, &panel.slice, &panel.start, &panel.end,
+                       &panel.depth}) {
+        std::memcpy(value, ptr, sizeof(int));
+        ptr += sizeof(int);
+    }
+    panel.data.resize((size_t)(panel.end - panel.start) * panel.depth);
+    std::memcpy(panel.data.data(), ptr, panel.data.size() * sizeof(double));
+    
+    return panel;
+}
+
+std::vector<char> NetworkMessage::serializeJobStart(int jobId, const std::string& sharedName) {
+    std::vector<char> data(sizeof(int) + sharedName.size());
+    std::memcpy(data.data(), &jobId, sizeof(int));
+    std::memcpy(data.data() + sizeof(int), sharedName.data(), sharedName.size());
+    return data;
+}
+
+int NetworkMessage::deserializeJobStart(const std::vector<char>& data, std::string& sharedName) {
+    int jobId = 0;
+    sharedName.clear();
+    if (data.size() < sizeof(int)) {
+        return jobId;
+    }
+    
+    std::memcpy(&jobId, data.data(), sizeof(int));
+    sharedName.assign(data.data() + sizeof(int), data.size() - sizeof(int));
+    return jobId;
+}
+
 std::vector<char> NetworkMessage::serializeResult(const Result& result) {
     std::vector<char> data;
-    size_t size = sizeof(int) * 5 + sizeof(double) * result.resultTile.size();
+    size_t size = sizeof(int) * 10 + sizeof(double) + sizeof(double) * result.resultTile.size();
+    int inPlace = result.inPlace ? 1 : 0;
     
     data.resize(size);
     char* ptr = data.data();
     
     std::memcpy(ptr, &result.taskId, sizeof(int));
     ptr += sizeof(int);
+    std::memcpy(ptr, &result.jobId, sizeof(int));
+    ptr += sizeof(int);
     std::memcpy(ptr, &result.startRow, sizeof(int));
     ptr += sizeof(int);
     std::memcpy(ptr, &result.endRow, sizeof(int));
@@ -100,8 +521,18 @@ std::vector<char> NetworkMessage::serializeResult(const Result& result) {
     ptr += sizeof(int);
     std::memcpy(ptr, &result.endCol, sizeof(int));
     ptr += sizeof(int);
+    std::memcpy(ptr, &result.startK, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &result.endK, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &result.requestCredits, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &inPlace, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(ptr, &result.executionTimeMs, sizeof(double));
+    ptr += sizeof(double);
     
-    // Copy result tile
+    // Copy result tile (empty when it was written in place)
     std::memcpy(ptr, result.resultTile.data(), sizeof(double) * result.resultTile.size());
     
     return data;
@@ -113,6 +544,8 @@ Result NetworkMessage::deserializeResult(const std::vector<char>& data) {
     
     std::memcpy(&result.taskId, ptr, sizeof(int));
     ptr += sizeof(int);
+    std::memcpy(&result.jobId, ptr, sizeof(int));
+    ptr += sizeof(int);
     std::memcpy(&result.startRow, ptr, sizeof(int));
     ptr += sizeof(int);
     std::memcpy(&result.endRow, ptr, sizeof(int));
@@ -121,6 +554,23 @@ Result NetworkMessage::deserializeResult(const std::vector<char>& data) {
     ptr += sizeof(int);
     std::memcpy(&result.endCol, ptr, sizeof(int));
     ptr += sizeof(int);
+    std::memcpy(&result.startK, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&result.endK, ptr, sizeof(int));
+    ptr += sizeof(int);
+    std::memcpy(&result.requestCredits, ptr, sizeof(int));
+    ptr += sizeof(int);
+    int inPlace;
+    std::memcpy(&inPlace, ptr, sizeof(int));
+    ptr += sizeof(int);
+    result.inPlace = inPlace != 0;
+    std::memcpy(&result.executionTimeMs, ptr, sizeof(double));
+    ptr += sizeof(double);
+    
+    // The tile already sits in shared memory
+    if (result.inPlace) {
+        return result;
+    }
     
     // Calculate size of result data
     int numRows = result.endRow - result.startRow;
@@ -184,7 +634,7 @@ bool NetworkMessage::sendMessage(int sockfd, MessageType type, const std::vector
     
     size_t totalSent = 0;
     while (totalSent < message.size()) {
-        ssize_t sent = send(sockfd, message.data() + totalSent, message.size() - totalSent, 0);
+        ssize_t sent = send(sockfd, message.data() + totalSent, message.size() - totalSent, MSG_NOSIGNAL);
         if (sent < 0) {
             return false;
         }
@@ -229,4 +679,13 @@ std::pair<MessageType, std::vector<char>> NetworkMessage::receiveMessage(int soc
     }
     
     return {type, payload};
-}
\ No newline at end of file
+}
+
+bool NetworkMessage::hasPendingData(int sockfd) {
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR));
+}
@@ -1,78 +1,122 @@
 #include "client.h"
+#include "shm_transport.h"
 #include <cstring>
 #include <iostream>
+#include <algorithm>
+#include <dirent.h>
+#include <sched.h>
+#include <tuple>
 
-Client::Client(const std::string& masterIp, int masterPort)
-    : masterIp_(masterIp), masterPort_(masterPort), socket_(-1), running_(false),
-      matrixA_(1, 1), matrixB_(1, 1), cpuClockSpeed_(detectCpuClockSpeed()) {}
+Client::Client(const std::string& masterIp, int masterPort, int prefetchDepth, IoBackend ioBackend)
+    : Client(Endpoint::tcp(masterIp, masterPort), prefetchDepth, ioBackend) {}
+
+Client::Client(const Endpoint& master, int prefetchDepth, IoBackend ioBackend)
+    : master_(master), socket_(-1), ioBackend_(ioBackend), running_(false),
+      taskQueue_(std::max(prefetchDepth, 1)), resultQueue_(std::max(prefetchDepth, 1)),
+      prefetchDepth_(std::max(prefetchDepth, 1)), tasksHeld_(0), masterDry_(false),
+      creditsInFlight_(0), computeJob_(0), cpuClockSpeed_(detectCpuClockSpeed()),
+      panels_(PANEL_CACHE_BYTES),
+      summa_([](const double* a, const double* b, int rows, int depth, int cols, double* out) {
+                 TileOperands ops = {a, b, depth, depth, cols, false, nullptr, nullptr};
+                 multiplyTile(ops, rows, cols, 0, out, cols);
+             },
+             [this](const SummaData& result) { sendSummaResult(result); }) {}
 
 Client::~Client() {
     disconnect();
 }
 
 bool Client::connect() {
-    socket_ = socket(AF_INET, SOCK_STREAM, 0);
+    // Calibrate before connecting, so the master never waits on us
+    Capabilities caps = detectCapabilities();
+    
+    socket_ = socket(master_.family(), SOCK_STREAM, 0);
     if (socket_ < 0) {
         std::cerr << "Error creating socket\n";
         return false;
     }
     
-    struct sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(masterPort_);
+    struct sockaddr_storage serverAddr;
+    socklen_t serverAddrLen = master_.toSockaddr(serverAddr);
     
-    if (inet_pton(AF_INET, masterIp_.c_str(), &serverAddr.sin_addr) <= 0) {
+    if (serverAddrLen == 0) {
         std::cerr << "Invalid address\n";
         close(socket_);
         socket_ = -1;
         return false;
     }
     
-    if (::connect(socket_, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+    if (::connect(socket_, (struct sockaddr*)&serverAddr, serverAddrLen) < 0) {
         std::cerr << "Connection failed\n";
         close(socket_);
         socket_ = -1;
         return false;
     }
     
-    std::cout << "Connected to master at " << masterIp_ << ":" << masterPort_ << std::endl;
+    std::cout << "Connected to master at " << master_.toString() << std::endl;
+    
+    transport_ = Transport::create(socket_, ioBackend_);
+    std::cout << "Using " << ioBackendName(transport_->backend()) << " I/O\n";
+    panels_.setFetcher([this](const std::vector<PanelKey>& panels) { requestPanels(panels); });
     
-    std::vector<char> cpuInfo(sizeof(double));
-    std::memcpy(cpuInfo.data(), &cpuClockSpeed_, sizeof(double));
-    if (!NetworkMessage::sendMessage(socket_, CPU_INFO, cpuInfo)) {
-        std::cerr << "Failed to send CPU info\n";
+    // Peers can only reach our relay and SUMMA listeners over TCP
+    bool tcp = master_.kind == Endpoint::ENDPOINT_TCP;
+    int relayPort = tcp ? relay_.listen() : 0;
+    int summaPort = tcp ? summa_.listen() : 0;
+    
+    // Introduce ourselves; the master sizes our work from the reply on
+    caps.prefetchDepth = prefetchDepth_;
+    caps.relayPort = relayPort;
+    caps.summaPort = summaPort;
+    if (!transport_->sendMessage(HELLO, NetworkMessage::serializeCapabilities(caps))) {
+        std::cerr << "Failed to send HELLO\n";
         disconnect();
         return false;
     }
     
-    std::cout << "Sent CPU clock speed: " << cpuClockSpeed_ << " GHz\n";
-
-    // Receive matrices from master
-    // auto [msgType1, payload1] = NetworkMessage::receiveMessage(socket_);
-    // if (msgType1 != MATRIX_DATA) {
-    //     std::cerr << "Expected matrix A data\n";
-    //     disconnect();
-    //     return false;
-    // }
-    // matrixA_ = NetworkMessage::deserializeMatrix(payload1);
-    
-    // auto [msgType2, payload2] = NetworkMessage::receiveMessage(socket_);
-    // if (msgType2 != MATRIX_DATA) {
-    //     std::cerr << "Expected matrix B data\n";
-    //     disconnect();
-    //     return false;
-    // }
-    // matrixB_ = NetworkMessage::deserializeMatrix(payload2);
+    // A job may be announced before we are welcomed; its tasks name it
+    auto [ackType, ackPayload] = transport_->receiveMessage();
+    while (ackType == JOB_START) {
+        noteJobStart(ackPayload);
+        std::tie(ackType, ackPayload) = transport_->receiveMessage();
+    }
+    HelloAck ack = NetworkMessage::deserializeHelloAck(ackPayload);
+    if (ackType != HELLO_ACK || ack.protocolVersion != PROTOCOL_VERSION) {
+        std::cerr << "Master does not speak protocol version " << PROTOCOL_VERSION << "\n";
+        disconnect();
+        return false;
+    }
+    prefetchDepth_ = std::max(1, std::min(prefetchDepth_, ack.prefetchDepth));
     
-    // std::cout << "Received matrices: A(" << matrixA_.rows() << "x" << matrixA_.cols() 
-    //           << "), B(" << matrixB_.rows() << "x" << matrixB_.cols() << ")" << std::endl;
+    std::cout << "Calibrated at " << caps.gflops << " GFLOP/s, " << caps.memoryGBps << " GB/s\n";
+    std::cout << "Reported " << caps.cores << " cores, " << simdLevelName(caps.simdLevel) << ", "
+              << caps.clockGHz << " GHz, L2 " << (caps.l2Bytes >> 10) << " KiB, L3 " << (caps.l3Bytes >> 10)
+              << " KiB, " << caps.numaNodes << " NUMA node(s); granted prefetch depth " << prefetchDepth_ << "\n";
+
+    // On the master's host, switch to shared memory: operands are mapped
+    // instead of transferred and results are written in place
+    if (ioBackend_ == IO_BACKEND_SHM) {
+        std::unique_ptr<Transport> shm = ShmTransport::negotiate(*transport_, socket_);
+        if (shm) {
+            transport_ = std::move(shm);
+            std::cout << "Master is local, using shared memory\n";
+            
+            // Operands are mapped, so we take no part in the broadcast
+            // or in SUMMA grids
+            relay_.stop();
+            summa_.stop();
+        }
+    }
     
+    // Remote clients fetch panels on demand as tasks arrive, or get the
+    // whole matrices through the broadcast tree (BROADCAST_PLAN)
     return true;
 }
 
 void Client::disconnect() {
     stop();
+    // Dropping the transport first lets it finish any write still in flight
+    transport_.reset();
     if (socket_ >= 0) {
         close(socket_);
         socket_ = -1;
@@ -85,49 +129,245 @@ void Client::start() {
         return;
     }
     
+    tasksHeld_ = 0;
+    masterDry_ = false;
+    creditsInFlight_ = 0;
+    outstandingRequests_.clear();
+    
     running_ = true;
-    workerThread_ = std::thread(&Client::workerLoop, this);
+    receiverThread_ = std::thread(&Client::receiveLoop, this);
+    computeThread_ = std::thread(&Client::computeLoop, this);
+    senderThread_ = std::thread(&Client::sendLoop, this);
 }
 
 void Client::stop() {
-    if (running_) {
-        running_ = false;
-        if (workerThread_.joinable()) {
-            workerThread_.join();
+    running_ = false;
+    
+    // Unblock a compute stage still waiting for operands
+    relay_.stop();
+    panels_.close();
+    summa_.stop();
+    
+    // Unblock the receiver if it is still waiting on the master
+    if (receiverThread_.joinable() && socket_ >= 0) {
+        shutdown(socket_, SHUT_RD);
+    }
+    taskQueue_.close();
+    resultQueue_.close();
+    
+    for (std::thread* stage : {&receiverThread_, &computeThread_, &senderThread_}) {
+        if (stage->joinable()) {
+            stage->join();
         }
     }
 }
 
-void Client::workerLoop() {
+int Client::availableCredits() const {
+    // After NO_WORK only ask again once everything we hold has been computed
+    if (masterDry_ && tasksHeld_ > 0) {
+        return 0;
+    }
+    return std::max(prefetchDepth_ - tasksHeld_ - creditsInFlight_, 0);
+}
+
+void Client::recordRequest(int credits) {
+    outstandingRequests_.push_back(credits);
+    creditsInFlight_ += credits;
+    masterDry_ = false;
+}
+
+void Client::requestOperands(size_t offset) {
+    std::lock_guard<std::mutex> lock(sendMutex_);
+    
+    std::vector<char> payload(sizeof(size_t));
+    std::memcpy(payload.data(), &offset, sizeof(size_t));
+    if (!transport_->sendMessage(OPERAND_REQUEST, payload)) {
+        std::cerr << "Error requesting operands\n";
+    }
+}
+
+void Client::requestPanels(const std::vector<PanelKey>& panels) {
+    std::lock_guard<std::mutex> lock(sendMutex_);
+    
+    if (!transport_->sendMessage(PANEL_REQUEST, NetworkMessage::serializePanelRequest(panels))) {
+        std::cerr << "Error requesting panels\n";
+    }
+}
+
+bool Client::usesPanels(const Task& task) const {
+    // Shared memory and the job's broadcast both provide whole matrices.
+    // The mapping belongs to the compute thread, so go by the backend.
+    return transport_->backend() != IO_BACKEND_SHM && !relay_.planned(task.jobId);
+}
+
+int Client::noteJobStart(const std::vector<char>& payload) {
+    std::string sharedName;
+    int jobId = NetworkMessage::deserializeJobStart(payload, sharedName);
+    std::lock_guard<std::mutex> lock(jobMutex_);
+    if (!finishedJobs_.count(jobId)) {
+        jobSegments_[jobId] = sharedName;
+    }
+    return jobId;
+}
+
+bool Client::enterJob(int jobId) {
+    std::lock_guard<std::mutex> lock(jobMutex_);
+    for (const std::string& name : retiredSegments_) {
+        transport_->releaseJob(name);
+    }
+    retiredSegments_.clear();
+    
+    if (finishedJobs_.count(jobId)) {
+        return false;
+    }
+    if (computeJob_ != jobId) {
+        auto segment = jobSegments_.find(jobId);
+        transport_->switchJob(segment != jobSegments_.end() ? segment->second : "");
+        computeJob_ = jobId;
+    }
+    return true;
+}
+
+bool Client::jobFinished(int jobId) {
+    std::lock_guard<std::mutex> lock(jobMutex_);
+    return finishedJobs_.count(jobId) > 0;
+}
+
+bool Client::dropTask(const Task& task) {
+    std::cout << "Dropping task " << task.taskId << " of finished job " << task.jobId << "\n";
+    {
+        std::lock_guard<std::mutex> lock(sendMutex_);
+        tasksHeld_--;
+    }
+    return topUpCredits();
+}
+
+bool Client::topUpCredits() {
+    std::lock_guard<std::mutex> lock(sendMutex_);
+    
+    int credits = availableCredits();
+    if (credits <= 0) {
+        return true;
+    }
+    
+    if (!transport_->sendMessage(TASK_REQUEST, NetworkMessage::serializeCredits(credits))) {
+        std::cerr << "Error requesting task\n";
+        return false;
+    }
+    recordRequest(credits);
+    return true;
+}
+
+void Client::receiveLoop() {
+    // The first request primes the pipeline; later ones ride on the results
+    if (!topUpCredits()) {
+        running_ = false;
+    }
+    
     while (running_) {
-        // Request a task from the master
-        if (!NetworkMessage::sendMessage(socket_, TASK_REQUEST, {})) {
-            std::cerr << "Error requesting task\n";
-            break;
-        }
+        auto [msgType, payload] = transport_->receiveMessage();
         
-        // Receive task or other response
-        auto [msgType, payload] = NetworkMessage::receiveMessage(socket_);
-        
-        if (msgType == TASK_RESPONSE) {
-            // Process the task
-            Task task = NetworkMessage::deserializeTask(payload);
-            std::cout << "Received task " << task.taskId << " (rows " << task.startRow 
-                      << " to " << task.endRow << ")\n";
+        if (msgType == TASK_BATCH || msgType == NO_WORK) {
+            std::vector<Task> tasks;
+            if (msgType == TASK_BATCH) {
+                tasks = NetworkMessage::deserializeTaskBatch(payload);
+            }
+            
+            // Settle the credits of the request this reply answers
+            {
+                std::lock_guard<std::mutex> lock(sendMutex_);
+                if (!outstandingRequests_.empty()) {
+                    creditsInFlight_ -= outstandingRequests_.front();
+                    outstandingRequests_.pop_front();
+                }
+                tasksHeld_ += tasks.size();
+                if (msgType == NO_WORK) {
+                    masterDry_ = true;
+                }
+            }
+            
+            // Start fetching the panels these tasks need while they queue
+            if (!tasks.empty() && usesPanels(tasks.front())) {
+                std::vector<PanelKey> needed;
+                for (const Task& task : tasks) {
+                    needed.push_back({PANEL_A, task.versionA, task.panelA, task.slice});
+                    needed.push_back({PANEL_B, task.versionB, task.panelB, task.slice});
+                }
+                panels_.prefetch(needed);
+            }
             
-            // Compute the result
-            Result result = computeMatrixMultiplication(task);
+            for (Task& task : tasks) {
+                taskQueue_.push(task);
+            }
             
-            // Send the result back
-            std::vector<char> resultData = NetworkMessage::serializeResult(result);
-            if (!NetworkMessage::sendMessage(socket_, COMPUTATION_RESULT, resultData)) {
-                std::cerr << "Error sending result\n";
-                break;
+            if (msgType == NO_WORK && tasksHeld_ == 0) {
+                // Everything was computed before the answer came; ask again
+                // right away, the master holds an idle client's request
+                // until there is work
+                masterDry_ = false;
+                if (!topUpCredits()) {
+                    break;
+                }
             }
         }
-        else if (msgType == NO_WORK) {
-            // No work available right now, wait and try again
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        else if (msgType == JOB_START) {
+            // Same connection, another job: credits, relay listener and the
+            // panel cache all carry over
+            int jobId = noteJobStart(payload);
+            std::cout << "Job " << jobId << " started\n";
+        }
+        else if (msgType == JOB_DONE) {
+            int jobId = 0;
+            if (payload.size() >= sizeof(int)) {
+                std::memcpy(&jobId, payload.data(), sizeof(int));
+            }
+            
+            // Its tasks still queued here are dropped, and its segment let go
+            {
+                std::lock_guard<std::mutex> lock(jobMutex_);
+                finishedJobs_.insert(jobId);
+                auto segment = jobSegments_.find(jobId);
+                if (segment != jobSegments_.end()) {
+                    if (!segment->second.empty()) {
+                        retiredSegments_.push_back(segment->second);
+                    }
+                    jobSegments_.erase(segment);
+                }
+            }
+            panels_.wake();
+            std::cout << "Job " << jobId << " finished\n";
+            if (panels_.hits() + panels_.misses() > 0) {
+                std::cout << "Panel cache: " << panels_.hits() << " hits, " << panels_.misses() << " misses, "
+                          << panels_.bytesFetched() / (1024.0 * 1024.0) << " MiB fetched\n";
+            }
+        }
+        else if (msgType == BROADCAST_PLAN) {
+            BroadcastPlan plan = NetworkMessage::deserializeBroadcastPlan(payload);
+            std::cout << "Job " << plan.jobId << ": receiving operands from "
+                      << (plan.parentHost.empty() ? "the master" : plan.parentHost + ":" + std::to_string(plan.parentPort))
+                      << ", relaying to " << plan.children << " peer(s)\n";
+            relay_.begin(plan, [this](size_t offset) { requestOperands(offset); });
+        }
+        else if (msgType == PANEL_DATA) {
+            panels_.insert(NetworkMessage::deserializePanel(payload));
+        }
+        else if (msgType == PANEL_GONE) {
+            panels_.gone(NetworkMessage::deserializePanelRequest(payload));
+        }
+        else if (msgType == OPERAND_CHUNK) {
+            const char* bytes;
+            size_t len;
+            size_t offset = NetworkMessage::deserializeOperandChunk(payload, bytes, len);
+            relay_.deliver(offset, bytes, len);
+        }
+        else if (msgType == SUMMA_PLAN) {
+            SummaPlan plan = NetworkMessage::deserializeSummaPlan(payload);
+            std::cout << "Job " << plan.jobId << ": SUMMA grid " << plan.gridRows << "x" << plan.gridCols
+                      << ", blocks of " << plan.blockSize << "\n";
+            summa_.begin(plan);
+        }
+        else if (msgType == SUMMA_OPERANDS) {
+            summa_.deliver(NetworkMessage::deserializeSummaData(payload));
         }
         else if (msgType == SHUTDOWN || msgType == CLIENT_DISCONNECT) {
             // Master sent shutdown signal
@@ -140,10 +380,293 @@ void Client::workerLoop() {
         }
     }
     
+    // Let the compute and send stages drain whatever is already queued
+    taskQueue_.close();
+    std::cout << "Receiver thread stopped\n";
+}
+
+void Client::computeLoop() {
+    Task task;
+    TileOperands ops;
+    while (taskQueue_.pop(task)) {
+        // A tile of a job that has since finished, e.g. one the master also
+        // gave another client as a backup: nobody wants its result
+        if (!enterJob(task.jobId)) {
+            if (!dropTask(task)) {
+                break;
+            }
+            continue;
+        }
+        
+        std::cout << "Received task " << task.taskId << " (rows " << task.startRow 
+                  << " to " << task.endRow << ")\n";
+        
+        // Tasks may overtake their operands; this waits for them. Their job
+        // may finish meanwhile, and its panels no longer be served.
+        if (!resolveOperands(task, ops)) {
+            if (!jobFinished(task.jobId) || !dropTask(task)) {
+                break;
+            }
+            continue;
+        }
+        
+        // Compute the result
+        if (!resultQueue_.push(computeMatrixMultiplication(task, ops))) {
+            break;
+        }
+    }
+    
+    resultQueue_.close();
+}
+
+bool Client::resolveOperands(const Task& task, TileOperands& ops) {
+    MatrixView a, b;
+    bool shared = transport_->sharedOperands(a, b);
+    
+    ops.relayed.reset();
+    if (!shared && relay_.planned(task.jobId)) {
+        ops.relayed = relay_.operands(task.jobId, a, b);
+        if (!ops.relayed) {
+            return false;
+        }
+        shared = true;
+    }
+    
+    if (shared) {
+        ops.aRows = &a.at(task.startRow, task.startK);
+        ops.b = &b.at(task.startK, 0);
+        ops.depth = task.endK - task.startK;
+        ops.lda = a.cols;
+        ops.ldb = b.cols;
+        ops.bTransposed = false;
+        ops.panelA.reset();
+        ops.panelB.reset();
+        return true;
+    }
+    
+    // Only the panels this task touches, from the cache or the master
+    auto abandon = [this, &task]() { return jobFinished(task.jobId); };
+    ops.panelA = panels_.acquire({PANEL_A, task.versionA, task.panelA, task.slice}, abandon);
+    ops.panelB = panels_.acquire({PANEL_B, task.versionB, task.panelB, task.slice}, abandon);
+    if (!ops.panelA || !ops.panelB) {
+        return false;
+    }
+    ops.depth = ops.panelA->depth;
+    ops.aRows = ops.panelA->data.data() + (size_t)(task.startRow - ops.panelA->start) * ops.depth;
+    ops.lda = ops.depth;
+    ops.b = ops.panelB->data.data() + (size_t)(task.startCol - ops.panelB->start) * ops.depth;
+    ops.ldb = ops.depth;
+    ops.bTransposed = true;
+    return true;
+}
+
+void Client::sendSummaResult(const SummaData& result) {
+    std::lock_guard<std::mutex> lock(sendMutex_);
+    
+    if (!transport_ || !transport_->sendMessage(SUMMA_RESULT, NetworkMessage::serializeSummaData(result))) {
+        std::cerr << "Error sending SUMMA result\n";
+    }
+}
+
+void Client::sendLoop() {
+    Result result;
+    while (resultQueue_.pop(result)) {
+        std::lock_guard<std::mutex> lock(sendMutex_);
+        tasksHeld_--;
+        
+        // Ask for replacements in the same message so the compute stage never
+        // runs dry and no separate TASK_REQUEST round trip is needed
+        result.requestCredits = running_ ? availableCredits() : 0;
+        
+        // Send the result back
+        std::vector<char> resultData = NetworkMessage::serializeResult(result);
+        if (!transport_->sendMessage(COMPUTATION_RESULT, resultData)) {
+            std::cerr << "Error sending result\n";
+            break;
+        }
+        if (result.requestCredits > 0) {
+            recordRequest(result.requestCredits);
+        }
+    }
+    
     std::cout << "Worker thread stopped\n";
 }
 
+// Size in bytes of the level-`level` data/unified cache of CPU 0, 0 if unknown
+static uint64_t readCacheSize(int level) {
+    for (int index = 0; index < 8; index++) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+        FILE* fp = fopen((dir + "level").c_str(), "r");
+        if (!fp) {
+            break;
+        }
+        int cacheLevel = 0;
+        bool ok = fscanf(fp, "%d", &cacheLevel) == 1;
+        fclose(fp);
+        
+        char type[32] = "";
+        fp = fopen((dir + "type").c_str(), "r");
+        if (fp) {
+            ok = ok && fscanf(fp, "%31s", type) == 1;
+            fclose(fp);
+        }
+        if (!ok || cacheLevel != level || strcmp(type, "Instruction") == 0) {
+            continue;
+        }
+        
+        // "2048K"
+        unsigned long long size = 0;
+        char unit = 'K';
+        fp = fopen((dir + "size").c_str(), "r");
+        if (fp) {
+            int fields = fscanf(fp, "%llu%c", &size, &unit);
+            fclose(fp);
+            if (fields >= 1) {
+                return size << (unit == 'M' ? 20 : unit == 'G' ? 30 : 10);
+            }
+        }
+    }
+    
+    // Containers sometimes hide sysfs; glibc asks CPUID instead
+    long size = sysconf(level == 2 ? _SC_LEVEL2_CACHE_SIZE : _SC_LEVEL3_CACHE_SIZE);
+    return size > 0 ? size : 0;
+}
+
+static int countNumaNodes() {
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (!dir) {
+        return 1;
+    }
+    int nodes = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4])) {
+            nodes++;
+        }
+    }
+    closedir(dir);
+    return std::max(nodes, 1);
+}
+
+// Calibration: repeat each micro-benchmark for at least this long and keep
+// the best run, so a stray interruption does not count against the client
+static const double CALIBRATION_SECONDS = 0.05;
+static const int CALIBRATION_TILE = 64;
+static const int CALIBRATION_DEPTH = 512;
+
+double Client::benchmarkGemm() {
+    // One tile over a transposed panel pair, the shape remote clients run
+    std::vector<double> a((size_t)CALIBRATION_TILE * CALIBRATION_DEPTH);
+    std::vector<double> b(a.size());
+    std::vector<double> c((size_t)CALIBRATION_TILE * CALIBRATION_TILE);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = 1.0 / (i + 1);
+        b[i] = 1.0 - a[i];
+    }
+    TileOperands ops = {a.data(), b.data(), CALIBRATION_DEPTH, CALIBRATION_DEPTH, CALIBRATION_DEPTH, true, nullptr, nullptr};
+    
+    double flops = 2.0 * CALIBRATION_TILE * CALIBRATION_TILE * CALIBRATION_DEPTH;
+    double best = 0.0;
+    double checksum = 0.0;
+    auto begin = std::chrono::steady_clock::now();
+    do {
+        auto start = std::chrono::steady_clock::now();
+        multiplyTile(ops, CALIBRATION_TILE, CALIBRATION_TILE, 0, c.data(), CALIBRATION_TILE);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        checksum += c[0];
+        if (seconds > 0) {
+            best = std::max(best, flops / seconds);
+        }
+    } while (std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < CALIBRATION_SECONDS);
+    
+    // Keep the kernel from being optimized away
+    volatile double sink = checksum;
+    (void)sink;
+    return best / 1e9;
+}
+
+double Client::benchmarkMemory(uint64_t l3Bytes) {
+    // Twice the L3 so the copy streams from memory, capped so calibration
+    // stays well under a second even on large-cache servers
+    size_t bytes = std::min<uint64_t>(std::max<uint64_t>(2 * l3Bytes, 16u << 20), 64u << 20);
+    std::vector<char> src(bytes, 1);
+    std::vector<char> dst(bytes, 0);  // Both touched, so no page faults below
+    
+    double best = 0.0;
+    int runs = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (runs < 3 ||
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < CALIBRATION_SECONDS) {
+        auto start = std::chrono::steady_clock::now();
+        std::memcpy(dst.data(), src.data(), bytes);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds > 0) {
+            best = std::max(best, 2.0 * bytes / seconds);
+        }
+        runs++;
+    }
+    
+    volatile char sink = dst[bytes / 2];
+    (void)sink;
+    return best / 1e9;
+}
+
+Capabilities Client::detectCapabilities() const {
+    Capabilities caps;
+    std::memset(&caps, 0, sizeof(caps));
+    caps.protocolVersion = PROTOCOL_VERSION;
+    caps.clockGHz = cpuClockSpeed_;
+    
+    // CPUs we may run on, not just the ones installed
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    caps.cores = (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) ? CPU_COUNT(&cpus)
+                                                                  : (int)std::max(1u, std::thread::hardware_concurrency());
+    
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        caps.simdLevel = SIMD_AVX512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        caps.simdLevel = SIMD_AVX2;
+    } else if (__builtin_cpu_supports("avx")) {
+        caps.simdLevel = SIMD_AVX;
+    } else if (__builtin_cpu_supports("sse2")) {
+        caps.simdLevel = SIMD_SSE2;
+    } else {
+        caps.simdLevel = SIMD_SCALAR;
+    }
+    
+    caps.l2Bytes = readCacheSize(2);
+    caps.l3Bytes = readCacheSize(3);
+    caps.numaNodes = countNumaNodes();
+    
+    // Memory free right now; operands, panels and tiles all come out of it
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    caps.memoryBytes = (pages > 0 && pageSize > 0) ? (uint64_t)pages * pageSize : 0;
+    
+    caps.dtypes = DTYPE_F64;
+    caps.codecs = CODEC_RAW;
+    
+    // What the client actually sustains, so the master can rank it in
+    // flop/s before the first result comes back
+    caps.gflops = benchmarkGemm();
+    caps.memoryGBps = benchmarkMemory(caps.l3Bytes);
+    return caps;
+}
+
 double Client::detectCpuClockSpeed() {
+    // The rated maximum where cpufreq exposes it; "cpu MHz" below is often
+    // just the idle frequency
+    FILE* maxFreq = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+    if (maxFreq) {
+        long khz = 0;
+        bool ok = fscanf(maxFreq, "%ld", &khz) == 1;
+        fclose(maxFreq);
+        if (ok && khz > 0) {
+            return khz / 1e6;
+        }
+    }
+    
     // Try to read CPU frequency from /proc/cpuinfo
     FILE* fp = fopen("/proc/cpuinfo", "r");
     if (!fp) return 2.0; // Default value if can't read
@@ -175,35 +698,61 @@ double Client::detectCpuClockSpeed() {
     return speed > 0.0 ? speed : 2.0; // Use default if couldn't determine
 }
 
-Result Client::computeMatrixMultiplication(const Task& task) {
+void Client::multiplyTile(const TileOperands& ops, int numRows, int numCols, int startCol, double* out, int ldOut) {
+    for (int localRow = 0; localRow < numRows; localRow++) {
+        const double* aRow = ops.aRows + (size_t)localRow * ops.lda;
+        for (int localCol = 0; localCol < numCols; localCol++) {
+            double sum = 0.0;
+            if (ops.bTransposed) {
+                // B panel rows are B's columns: both operands contiguous
+                const double* bRow = ops.b + (size_t)localCol * ops.depth;
+                for (int k = 0; k < ops.depth; k++) {
+                    sum += aRow[k] * bRow[k];
+                }
+            } else {
+                const double* bCol = ops.b + startCol + localCol;
+                for (int k = 0; k < ops.depth; k++) {
+                    sum += aRow[k] * bCol[(size_t)k * ops.ldb];
+                }
+            }
+            out[(size_t)localRow * ldOut + localCol] = sum;
+        }
+    }
+}
+
+Result Client::computeMatrixMultiplication(const Task& task, const TileOperands& ops) {
     // Start timing
     taskStartTime_ = std::chrono::high_resolution_clock::now();
 
     Result result;
     result.taskId = task.taskId;
+    result.jobId = task.jobId;
     result.startRow = task.startRow;
     result.endRow = task.endRow;
     result.startCol = task.startCol;
     result.endCol = task.endCol;
+    result.startK = task.startK;
+    result.endK = task.endK;
+    result.requestCredits = 0;
     
-    // Size for the result tile
+    // Write straight into the shared result matrix if there is one,
+    // otherwise into a tile that is sent back. A partial sum over a slice
+    // of the inner dimension always goes back: the master adds them up.
     int numRows = task.endRow - task.startRow;
     int numCols = task.endCol - task.startCol;
-    result.resultTile.resize(numRows * numCols, 0.0);
-    
-    // Extract the needed parts of the matrices for this tile
-    for (int i = task.startRow; i < task.endRow; i++) {
-        for (int j = task.startCol; j < task.endCol; j++) {
-            double sum = 0.0;
-            for (int k = 0; k < matrixA_.cols(); k++) {
-                sum += matrixA_.at(i, k) * matrixB_.at(k, j);
-            }
-            int localRow = i - task.startRow;
-            int localCol = j - task.startCol;
-            result.resultTile[localRow * numCols + localCol] = sum;
-        }
+    int resultCols = numCols;
+    bool partial = task.endK - task.startK < task.matrixSize;
+    double* out = partial ? nullptr : transport_->sharedResult(resultCols);
+    result.inPlace = out != nullptr;
+    if (out) {
+        out += (size_t)task.startRow * resultCols + task.startCol;
+    } else {
+        result.resultTile.resize(numRows * numCols, 0.0);
+        out = result.resultTile.data();
     }
     
+    multiplyTile(ops, numRows, numCols, task.startCol, out, resultCols);
+    
     // Compute the task execution time
     auto endTime = std::chrono::high_resolution_clock::now();
     double taskTimeMs = std::chrono::duration<double, std::milli>(endTime - taskStartTime_).count();
@@ -1,12 +1,28 @@
 #pragma once
 #include "common.h"
+#include "endpoint.h"
+#include "panel_cache.h"
+#include "relay.h"
+#include "spsc_queue.h"
+#include "summa.h"
+#include "transport.h"
 #include <thread>
 #include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
 #include <immintrin.h>  // For SIMD instructions
 
+// Byte budget of the client's operand panel cache
+#define PANEL_CACHE_BYTES (256u << 20)
+
 class Client {
 public:
-    Client(const std::string& masterIp, int masterPort);
+    Client(const std::string& masterIp, int masterPort, int prefetchDepth = DEFAULT_PREFETCH_DEPTH,
+           IoBackend ioBackend = IO_BACKEND_SHM);
+    Client(const Endpoint& master, int prefetchDepth = DEFAULT_PREFETCH_DEPTH,
+           IoBackend ioBackend = IO_BACKEND_SHM);
     ~Client();
     
     bool connect();
@@ -15,24 +31,91 @@ public:
     void stop();
 
 private:
-    std::string masterIp_;
-    int masterPort_;
+    Endpoint master_;  // TCP address or unix socket of the master
     int socket_;
+    IoBackend ioBackend_;
+    std::unique_ptr<Transport> transport_;  // Framed messages over socket_
     std::atomic<bool> running_;
-    std::thread workerThread_;
+    
+    // Pipeline stages: the receiver fills taskQueue_ for task N+1 while the
+    // compute thread works on task N and the sender streams task N-1's result
+    std::thread receiverThread_;
+    std::thread computeThread_;
+    std::thread senderThread_;
+    SpscQueue<Task> taskQueue_;      // receiver -> compute
+    SpscQueue<Result> resultQueue_;  // compute -> sender
+    
+    // Credit-based prefetch: tasks held locally plus credits still
+    // awaiting a reply never exceed prefetchDepth_
+    int prefetchDepth_;
+    std::atomic<int> tasksHeld_;       // Granted tasks whose result has not been sent
+    std::atomic<bool> masterDry_;      // Master answered NO_WORK to our last request
+    std::mutex sendMutex_;             // Serializes socket writes and the fields below
+    int creditsInFlight_;
+    std::deque<int> outstandingRequests_;  // Credits of each unanswered TASK_REQUEST
+
+    // Jobs as announced by JOB_START and ended by JOB_DONE (several may run
+    // at once), and the one the compute stage has mapped. The compute
+    // thread switches the shared-memory mapping itself whenever a task of
+    // another job comes up, so no tile loses it midway, and releases the
+    // segments of finished jobs between tasks.
+    std::mutex jobMutex_;
+    std::map<int, std::string> jobSegments_;   // <job, segment name>
+    std::set<int> finishedJobs_;
+    std::vector<std::string> retiredSegments_;  // Of finished jobs, not yet released
+    int computeJob_;
+    int noteJobStart(const std::vector<char>& payload);  // Returns the job id
+    bool enterJob(int jobId);  // False for a task of a finished job
+    bool jobFinished(int jobId);
+    bool dropTask(const Task& task);  // Give up a task of a finished job; false if the link failed
 
     // Task timing
     double cpuClockSpeed_;  // CPU clock speed in GHz
     std::chrono::time_point<std::chrono::high_resolution_clock> taskStartTime_;
     
-    // CPU speed detection
+    // CPU speed and capability detection for HELLO
     double detectCpuClockSpeed();
+    Capabilities detectCapabilities() const;
+    static double benchmarkGemm();                     // GFLOP/s of multiplyTile
+    static double benchmarkMemory(uint64_t l3Bytes);   // GB/s of a large copy
+    
+    // Operands for clients that do not share memory with the master: the
+    // whole matrices from the broadcast tree, or panels fetched on demand
+    OperandRelay relay_;
+    PanelCache panels_;
+    
+    // Our part of a SUMMA job: operands from the master, panels from peers
+    SummaNode summa_;
+    void sendSummaResult(const SummaData& result);
+    
+    // Where a task's operands live: row task.startRow of A, and either B
+    // itself or the task's transposed B panel, over its inner slice
+    struct TileOperands {
+        const double* aRows;   // Rows `lda` elements apart, from the task's startK
+        const double* b;       // B (ldb elements per row, from row startK) or B^T rows for [startCol, endCol)
+        int depth;
+        int lda;
+        int ldb;
+        bool bTransposed;
+        std::shared_ptr<const Panel> panelA, panelB;  // Keep fetched panels alive
+        std::shared_ptr<const std::vector<char>> relayed;  // And broadcast operands
+    };
+    bool usesPanels(const Task& task) const;
+    bool resolveOperands(const Task& task, TileOperands& ops);
+    void requestPanels(const std::vector<PanelKey>& panels);
     
-    Matrix matrixA_;
-    Matrix matrixB_;
+    void receiveLoop();
+    void computeLoop();
+    void sendLoop();
+    bool topUpCredits();
+    int availableCredits() const;      // Caller holds sendMutex_
+    void recordRequest(int credits);   // Caller holds sendMutex_
+    void requestOperands(size_t offset);
+    Result computeMatrixMultiplication(const Task& task, const TileOperands& ops);
     
-    void workerLoop();
-    Result computeMatrixMultiplication(const Task& task);
+    // The tile kernel: out (ldOut elements per row) = A rows x B columns
+    // [startCol, startCol + numCols)
+    static void multiplyTile(const TileOperands& ops, int numRows, int numCols, int startCol, double* out, int ldOut);
     
     // SIMD optimized matrix multiplication
     void multiplyRowsSIMD(const Matrix& a, const Matrix& b, std::vector<double>& result, 
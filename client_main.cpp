@@ -4,16 +4,40 @@
 #include <chrono>
 
 int main(int argc, char* argv[]) {
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <master_ip> <master_port>\n";
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <master_ip> <master_port> [prefetch_depth="
+                  << DEFAULT_PREFETCH_DEPTH << "] [io_backend=shm|blocking|uring]\n"
+                  << "       " << argv[0] << " <host:port|unix:/path|unix:@name> [prefetch_depth] [io_backend]\n";
         return 1;
     }
     
-    std::string masterIp = argv[1];
-    int masterPort = std::stoi(argv[2]);
+    // Either a single endpoint or the original "<ip> <port>" pair
+    Endpoint master;
+    int optionArg = 2;
+    std::string first = argv[1];
+    if (first.find(':') != std::string::npos) {
+        if (!Endpoint::parse(first, master)) {
+            std::cerr << "Invalid master endpoint: " << first << "\n";
+            return 1;
+        }
+    } else if (argc > 2) {
+        master = Endpoint::tcp(first, std::stoi(argv[2]));
+        optionArg = 3;
+    } else {
+        std::cerr << "Missing master port\n";
+        return 1;
+    }
+    
+    int prefetchDepth = (argc > optionArg) ? std::stoi(argv[optionArg]) : DEFAULT_PREFETCH_DEPTH;
+    
+    IoBackend ioBackend = IO_BACKEND_SHM;
+    if (argc > optionArg + 1 && !parseIoBackend(argv[optionArg + 1], ioBackend)) {
+        std::cerr << "Unknown I/O backend: " << argv[optionArg + 1] << "\n";
+        return 1;
+    }
     
     // Create client
-    Client client(masterIp, masterPort);
+    Client client(master, prefetchDepth, ioBackend);
     
     // Connect to master
     if (!client.connect()) {
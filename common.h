@@ -19,9 +19,86 @@ enum MessageType {
     COMPUTATION_RESULT = 6,
     NO_WORK = 7,
     SHUTDOWN = 8,
-    CPU_INFO = 9
+    CPU_INFO = 9,     // Superseded by HELLO
+    TASK_BATCH = 10,  // Several tasks granted against one TASK_REQUEST
+    SHM_REQUEST = 11, // Client asks to switch to shared memory (see shm_transport.h)
+    SHM_OFFER = 12,
+    SHM_ATTACHED = 13,
+    SHM_DECLINE = 14,
+    BROADCAST_PLAN = 15,  // Where this client gets operands from and how many peers it feeds
+    OPERAND_CHUNK = 16,   // A slice of the operands (A then B), from the master or a parent peer
+    OPERAND_REQUEST = 17, // Client asks the master to stream operands from an offset
+    PANEL_REQUEST = 18,   // Client asks for the A/B panels missing from its cache
+    PANEL_DATA = 19,      // One panel, in reply to PANEL_REQUEST
+    JOB_START = 20,       // A job is running, maybe beside others: its id and shared-memory job segment
+    JOB_DONE = 21,        // A job finished; the connection stays open for the others
+    HELLO = 22,           // First client message: protocol version and capabilities
+    HELLO_ACK = 23,       // Master's reply: its protocol version and what it grants the client
+    SUMMA_PLAN = 24,      // This client's place in the job's SUMMA grid and its peers
+    SUMMA_OPERANDS = 25,  // The client's block-cyclic piece of A or B
+    SUMMA_PANEL = 26,     // Peer to peer: one step's A or B panel along a grid row or column
+    SUMMA_RESULT = 27,    // The client's block-cyclic piece of C, or word that it gave up
+    PANEL_GONE = 28       // Panels of a PANEL_REQUEST the master cannot serve; same payload
 };
 
+// Wire protocol revision; both sides must agree in HELLO
+#define PROTOCOL_VERSION 7
+
+// Number of tasks a client keeps outstanding unless told otherwise
+#define DEFAULT_PREFETCH_DEPTH 4
+
+// Widest vector instructions a client can run
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX = 2,
+    SIMD_AVX2 = 3,
+    SIMD_AVX512 = 4
+};
+
+inline const char* simdLevelName(int level) {
+    switch (level) {
+        case SIMD_SSE2: return "SSE2";
+        case SIMD_AVX: return "AVX";
+        case SIMD_AVX2: return "AVX2";
+        case SIMD_AVX512: return "AVX-512";
+        default: return "scalar";
+    }
+}
+
+// Element types and operand encodings a client handles, as bit sets
+#define DTYPE_F64 (1u << 0)
+#define CODEC_RAW (1u << 0)
+
+// What a client reports about itself in HELLO
+struct Capabilities {
+    int protocolVersion;
+    int cores;             // CPUs the client may run on
+    int simdLevel;         // SimdLevel
+    int numaNodes;
+    int prefetchDepth;     // Max tasks the client wants outstanding
+    int relayPort;         // Operand relay listener, 0 if it cannot relay
+    int summaPort;         // SUMMA peer listener, 0 if it cannot take part
+    uint32_t dtypes;       // DTYPE_* bits
+    uint32_t codecs;       // CODEC_* bits
+    double clockGHz;       // Maximum core clock
+    double gflops;         // Measured tile kernel throughput, 1e9 flop/s
+    double memoryGBps;     // Measured memory copy bandwidth, read plus write
+    uint64_t l2Bytes;      // Per-core L2, 0 if unknown
+    uint64_t l3Bytes;      // Shared L3, 0 if unknown
+    uint64_t memoryBytes;  // Memory the client can spend on operands and results
+};
+
+// The master's answer to HELLO
+struct HelloAck {
+    int protocolVersion;
+    int prefetchDepth;     // Tasks the client may hold; never above what it asked for
+};
+
+// Operand broadcast: peers each client relays to, and bytes per OPERAND_CHUNK
+#define BROADCAST_FANOUT 2
+#define BROADCAST_CHUNK_SIZE (256 * 1024)
+
 // Task structure for matrix multiplication
 struct Task {
     int taskId;
@@ -30,17 +107,148 @@ struct Task {
     int startCol;  // Start column for tiled multiplication
     int endCol;    // End column for tiled multiplication
     int matrixSize;
+    int panelA;    // A row panel covering [startRow, endRow)
+    int panelB;    // B column panel covering [startCol, endCol)
+    int jobId;     // Job this tile belongs to
+    int versionA;  // Operand versions; panels of an unchanged operand
+    int versionB;  // stay valid from one job to the next
+    int startK;    // Inner dimension range [startK, endK); short of the
+    int endK;      // whole, the result is a partial sum the master adds up
+    int slice;     // Index of that range among the job's; names its panels
+};
+
+// Operand panels fetched on demand. An A panel is a block of rows of A; a
+// B panel is a block of columns of B, stored transposed so both operands
+// of a dot product are contiguous. Either way `data` holds (end - start)
+// rows of `depth` elements: the inner dimension slice the panel covers,
+// all of it unless the job splits it.
+enum PanelKind {
+    PANEL_A = 0,
+    PANEL_B = 1
+};
+
+// Names one panel of one version of an operand
+struct PanelKey {
+    int kind;
+    int version;
+    int index;
+    int slice;
+};
+
+// One integer per PanelKey, for caches and sets: version, 7 bits of slice,
+// kind and index
+inline uint64_t panelKeyId(const PanelKey& panel) {
+    return ((uint64_t)(uint32_t)panel.version << 40) | ((uint64_t)(panel.slice & 0x7f) << 33) |
+           ((uint64_t)(panel.kind & 1) << 32) | (uint32_t)panel.index;
+}
+
+struct Panel {
+    int kind;
+    int version;
+    int index;
+    int slice;
+    int start;
+    int end;
+    int depth;
+    std::vector<double> data;
 };
 
 // Result structure
 struct Result {
     int taskId;
+    int jobId;
     int startRow;
     int endRow;
     int startCol;
     int endCol;
+    int startK;              // Inner dimension range summed; short of the
+    int endK;                // whole, resultTile is a partial sum
     std::vector<double> resultTile;
     double executionTimeMs;  // Task execution time in milliseconds
+    int requestCredits;      // Piggybacked TASK_REQUEST: tasks wanted in reply (0 = none)
+    bool inPlace;            // Tile was written to shared memory; resultTile is empty
+};
+
+// Operand distribution plan for one client. The operands are A's elements
+// followed by B's, streamed as OPERAND_CHUNKs in order.
+struct BroadcastPlan {
+    int jobId;
+    int rowsA, colsA;
+    int rowsB, colsB;
+    std::string parentHost;  // Relay to connect to; empty when the master streams to us
+    int parentPort;
+    int children;            // Peers that will connect to our relay listener
+};
+
+// End of the tile (or panel, or SUMMA block) starting at `start` along an
+// extent: a remainder shorter than half an edge joins the last tile
+// instead of becoming a sliver of its own
+inline int tileEnd(int start, int edge, int extent) {
+    int end = start + edge;
+    return (extent - end < edge / 2) ? extent : end;
+}
+
+// Number of tiles of `edge` covering `extent`, slivers coalesced
+inline int tileCount(int edge, int extent) {
+    return (extent - edge / 2 > 0 ? extent - edge / 2 : 0) / edge + 1;
+}
+
+// SUMMA: clients form a gridRows x gridCols grid. A, B and C are cut into
+// blocks of `blockSize` (tileEnd's rule) and dealt out block-cyclically:
+// block (i, j) of any of them belongs to grid position
+// (i % gridRows, j % gridCols). Step k, the owners of A's block column k
+// send it along their grid rows and the owners of B's block row k along
+// their grid columns, and every client adds the product to its C.
+struct SummaPlan {
+    int jobId;
+    int gridRows, gridCols;
+    int row, col;            // This client's grid position
+    int blockSize;
+    int m, n, k;             // C is m x n, the inner dimension k
+    std::vector<std::pair<std::string, int>> peers;  // Listener of each position, row-major
+};
+
+// Pieces of a SUMMA job on the wire
+enum SummaPiece {
+    SUMMA_A = 0,
+    SUMMA_B = 1,
+    SUMMA_C = 2
+};
+
+// A client's local piece of A, B or C, or one step's panel. The blocks it
+// owns are packed in order, row-major; step is -1 in a SUMMA_RESULT from a
+// client that gave up.
+struct SummaData {
+    int jobId;
+    int piece;  // SummaPiece
+    int step;
+    int rows, cols;
+    std::vector<double> data;
+};
+
+// Elements of `extent` held by grid position `me` of `procs`, and where
+// block `block` starts within its owner's piece (every earlier block of
+// the owner is a full edge; only the last block of all can be longer)
+inline int cyclicExtent(int extent, int edge, int procs, int me) {
+    int total = 0;
+    for (int block = me, count = tileCount(edge, extent); block < count; block += procs) {
+        total += tileEnd(block * edge, edge, extent) - block * edge;
+    }
+    return total;
+}
+inline int cyclicOffset(int block, int edge, int procs) {
+    return (block / procs) * edge;
+}
+
+// Read-only view of row-major matrix data owned elsewhere
+struct MatrixView {
+    const double* data;
+    int rows;
+    int cols;
+
+    inline const double& at(int row, int col) const {
+        return data[(size_t)row * cols + col];
+    }
 };
 
 // Matrix representation
@@ -109,6 +317,7 @@ class Matrix {
         int cols() const { return cols_; }
         double* data() { return data_; }
         const double* data() const { return data_; }
+        MatrixView view() const { return {data_, rows_, cols_}; }
     
     private:
         int rows_;
@@ -125,6 +334,47 @@ public:
     static std::vector<char> serializeTask(const Task& task);
     static Task deserializeTask(const std::vector<char>& data);
     
+    static std::vector<char> serializeTaskBatch(const std::vector<Task>& tasks);
+    static std::vector<Task> deserializeTaskBatch(const std::vector<char>& data);
+    
+    // TASK_REQUEST payload: number of additional tasks (credits) the client wants
+    static std::vector<char> serializeCredits(int credits);
+    static int deserializeCredits(const std::vector<char>& data);
+    
+    static std::vector<char> serializeCapabilities(const Capabilities& caps);
+    static Capabilities deserializeCapabilities(const std::vector<char>& data);
+    
+    static std::vector<char> serializeHelloAck(const HelloAck& ack);
+    static HelloAck deserializeHelloAck(const std::vector<char>& data);
+    
+    static std::vector<char> serializeBroadcastPlan(const BroadcastPlan& plan);
+    static BroadcastPlan deserializeBroadcastPlan(const std::vector<char>& data);
+    
+    static std::vector<char> serializeSummaPlan(const SummaPlan& plan);
+    static SummaPlan deserializeSummaPlan(const std::vector<char>& data);
+    
+    // SUMMA_OPERANDS, SUMMA_PANEL and SUMMA_RESULT payloads
+    static std::vector<char> serializeSummaData(const SummaData& piece);
+    static SummaData deserializeSummaData(const std::vector<char>& data);
+    
+    // OPERAND_CHUNK payload: byte offset into the operands, then the bytes
+    static std::vector<char> serializeOperandChunk(size_t offset, const char* bytes, size_t len);
+    static size_t deserializeOperandChunk(const std::vector<char>& data, const char*& bytes, size_t& len);
+    
+    // PANEL_REQUEST and PANEL_GONE payload: (kind, version, index) triples
+    static std::vector<char> serializePanelRequest(const std::vector<PanelKey>& panels);
+    static std::vector<PanelKey> deserializePanelRequest(const std::vector<char>& data);
+    
+    // PANEL_DATA payload; `rows` points at (end - start) rows of `depth`
+    // elements, `stride` apart
+    static std::vector<char> serializePanel(const PanelKey& key, int start, int end, int depth, const double* rows,
+                                            int stride);
+    static Panel deserializePanel(const std::vector<char>& data);
+    
+    // JOB_START payload: job id, then the job segment name (empty without shared memory)
+    static std::vector<char> serializeJobStart(int jobId, const std::string& sharedName);
+    static int deserializeJobStart(const std::vector<char>& data, std::string& sharedName);
+    
     static std::vector<char> serializeResult(const Result& result);
     static Result deserializeResult(const std::vector<char>& data);
     
@@ -134,4 +384,7 @@ public:
     // Helper to send/receive messages over sockets
     static bool sendMessage(int sockfd, MessageType type, const std::vector<char>& payload);
     static std::pair<MessageType, std::vector<char>> receiveMessage(int sockfd);
+    
+    // True if a message (or part of one) is waiting on the socket
+    static bool hasPendingData(int sockfd);
 };
\ No newline at end of file
@@ -0,0 +1,341 @@
+#include "connection.h"
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+
+// Upper bound on iovecs handed to one sendmsg call
+static const size_t MAX_WRITE_BATCH = 16;
+
+// Bursts smaller than this mostly vanish into the socket buffer, so their
+// drain time says nothing about the link
+static const size_t LINK_SAMPLE_BYTES = 256 * 1024;
+
+MessageReader::MessageReader()
+    : headerReceived_(0), readingPayload_(false), payloadReceived_(0) {}
+
+void MessageReader::window(char*& dst, size_t& want) {
+    if (readingPayload_) {
+        dst = payload_.data() + payloadReceived_;
+        want = payload_.size() - payloadReceived_;
+    } else {
+        dst = header_ + headerReceived_;
+        want = sizeof(header_) - headerReceived_;
+    }
+}
+
+void MessageReader::advance(size_t received, const MessageHandler& handler) {
+    if (!readingPayload_) {
+        headerReceived_ += received;
+        if (headerReceived_ < sizeof(header_)) {
+            return;
+        }
+
+        // Header complete: size the payload buffer and switch state
+        size_t payloadSize;
+        std::memcpy(&payloadSize, header_ + sizeof(MessageType), sizeof(size_t));
+        payload_.assign(payloadSize, 0);
+        payloadReceived_ = 0;
+        readingPayload_ = true;
+    } else {
+        payloadReceived_ += received;
+    }
+
+    if (payloadReceived_ == payload_.size()) {
+        MessageType type;
+        std::memcpy(&type, header_, sizeof(MessageType));
+
+        std::vector<char> payload;
+        payload.swap(payload_);
+        headerReceived_ = 0;
+        readingPayload_ = false;
+
+        handler(type, payload);
+    }
+}
+
+bool MessageReader::readFrom(int fd, const MessageHandler& handler) {
+    while (true) {
+        char* dst;
+        size_t want;
+        window(dst, want);
+
+        ssize_t received = recv(fd, dst, want, 0);
+        if (received == 0) {
+            return false;  // Peer closed the connection
+        }
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        advance(received, handler);
+    }
+}
+
+void MessageReader::feed(const char* data, size_t len, const MessageHandler& handler) {
+    while (len > 0) {
+        char* dst;
+        size_t want;
+        window(dst, want);
+
+        size_t take = std::min(want, len);
+        std::memcpy(dst, data, take);
+        data += take;
+        len -= take;
+
+        advance(take, handler);
+    }
+}
+
+Connection::Connection(int fd, const std::string& peer)
+    : fd_(fd), peer_(peer), closed_(false), frontOffset_(0), closeAfterFlush_(false), holding_(false),
+      burstBytes_(0), drainRate_(0.0) {}
+
+Connection::~Connection() {
+    markClosed();
+}
+
+bool Connection::readAvailable(const MessageHandler& handler) {
+    return !closed_ && reader_.readFrom(fd_, handler);
+}
+
+void Connection::feed(const char* data, size_t len, const MessageHandler& handler) {
+    if (!closed_) {
+        reader_.feed(data, len, handler);
+    }
+}
+
+bool Connection::queueMessage(MessageType type, const std::vector<char>& payload) {
+    return queue(type, payload, false);
+}
+
+bool Connection::queue(MessageType type, const std::vector<char>& payload, bool hold) {
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        if (closed_ || closeAfterFlush_) {
+            return false;
+        }
+        if (holding_) {
+            held_.push_back(NetworkMessage::createMessage(type, payload));
+            return true;
+        }
+
+        if (outbox_.empty()) {
+            burstStart_ = std::chrono::steady_clock::now();
+            burstBytes_ = 0;
+        }
+        outbox_.push_back(NetworkMessage::createMessage(type, payload));
+        holding_ = hold;
+        if (!writeNotifier_) {
+            return flushLocked();
+        }
+        notify = writeNotifier_;
+    }
+
+    // The event loop writes for us; tell it there is output
+    notify();
+    return true;
+}
+
+bool Connection::flush() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    return writeNotifier_ ? true : flushLocked();
+}
+
+bool Connection::flushLocked() {
+    while (!outbox_.empty() && !closed_) {
+        // Gather several queued messages into one sendmsg call
+        struct iovec iov[MAX_WRITE_BATCH];
+        size_t count = 0;
+        for (auto it = outbox_.begin(); it != outbox_.end() && count < MAX_WRITE_BATCH; ++it, ++count) {
+            size_t offset = (count == 0) ? frontOffset_ : 0;
+            iov[count].iov_base = it->data() + offset;
+            iov[count].iov_len = it->size() - offset;
+        }
+
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t sent = sendmsg(fd_, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;  // EPOLLOUT will call us again
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        dropWritten(sent);
+    }
+
+    shutdownIfDrained();
+    return true;
+}
+
+void Connection::dropWritten(size_t written) {
+    burstBytes_ += written;
+
+    // Drop fully written messages
+    while (written > 0 && !outbox_.empty()) {
+        size_t left = outbox_.front().size() - frontOffset_;
+        if (written < left) {
+            frontOffset_ += written;
+            break;
+        }
+        written -= left;
+        outbox_.pop_front();
+        frontOffset_ = 0;
+    }
+
+    // A large burst drained: sample the link's throughput
+    if (outbox_.empty() && burstBytes_ >= LINK_SAMPLE_BYTES) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - burstStart_).count();
+        if (seconds > 0) {
+            double rate = burstBytes_ / seconds;
+            double previous = drainRate_;
+            drainRate_ = (previous > 0) ? 0.7 * previous + 0.3 * rate : rate;
+        }
+        burstBytes_ = 0;
+    }
+}
+
+void Connection::shutdownIfDrained() {
+    // Everything written: shutting the socket down wakes the owning event
+    // loop with EOF, which then tears the connection down
+    if (closeAfterFlush_ && outbox_.empty() && !closed_) {
+        shutdown(fd_, SHUT_RDWR);
+    }
+}
+
+void Connection::setWriteNotifier(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    writeNotifier_ = std::move(notify);
+}
+
+bool Connection::queueAndHold(MessageType type, const std::vector<char>& payload) {
+    return queue(type, payload, true);
+}
+
+void Connection::releaseOutput() {
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        holding_ = false;
+        if (closed_ || held_.empty()) {
+            held_.clear();
+            return;
+        }
+        if (outbox_.empty()) {
+            burstStart_ = std::chrono::steady_clock::now();
+            burstBytes_ = 0;
+        }
+        std::move(held_.begin(), held_.end(), std::back_inserter(outbox_));
+        held_.clear();
+        if (!writeNotifier_) {
+            flushLocked();
+            return;
+        }
+        notify = writeNotifier_;
+    }
+    notify();
+}
+
+bool Connection::nextOutput(const char*& data, size_t& len) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (closed_ || outbox_.empty()) {
+        return false;
+    }
+
+    // Deque elements stay put while other threads append, so the pointer
+    // remains valid until consumeOutput pops the message
+    data = outbox_.front().data() + frontOffset_;
+    len = outbox_.front().size() - frontOffset_;
+    return true;
+}
+
+size_t Connection::gatherOutput(char* dst, size_t capacity) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (closed_) {
+        return 0;
+    }
+
+    size_t copied = 0;
+    size_t offset = frontOffset_;
+    for (auto it = outbox_.begin(); it != outbox_.end() && copied < capacity; ++it) {
+        size_t take = std::min(it->size() - offset, capacity - copied);
+        std::memcpy(dst + copied, it->data() + offset, take);
+        copied += take;
+        offset = 0;
+    }
+    return copied;
+}
+
+void Connection::consumeOutput(size_t written) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    dropWritten(written);
+    shutdownIfDrained();
+}
+
+void Connection::closeAfterFlush() {
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        closeAfterFlush_ = true;
+        if (!writeNotifier_) {
+            flushLocked();
+            return;
+        }
+        shutdownIfDrained();
+        notify = writeNotifier_;
+    }
+    notify();
+}
+
+static bool tcpInfo(int fd, struct tcp_info& info) {
+    socklen_t len = sizeof(info);
+    return getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 && info.tcpi_rtt > 0;
+}
+
+double Connection::rttMs() const {
+    struct tcp_info info;
+    return (!closed_ && tcpInfo(fd_, info)) ? info.tcpi_rtt / 1000.0 : 0.0;
+}
+
+double Connection::sendRate() const {
+    if (drainRate_ > 0) {
+        return drainRate_;
+    }
+
+    // Nothing large sent yet: what the congestion window allows per round trip
+    struct tcp_info info;
+    if (closed_ || !tcpInfo(fd_, info)) {
+        return 0.0;
+    }
+    return (double)info.tcpi_snd_cwnd * info.tcpi_snd_mss / (info.tcpi_rtt / 1e6);
+}
+
+void Connection::markClosed() {
+    // Closing under the write lock keeps other threads from writing to a
+    // descriptor number that may already have been reused
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (!closed_) {
+        closed_ = true;
+        close(fd_);
+    }
+    outbox_.clear();
+    held_.clear();
+    writeNotifier_ = nullptr;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+// Incremental decoder for the framed wire format: a small state machine
+// (header, then payload) so a partial read resumes where it stopped. Bytes
+// come straight from a socket (readFrom) or from buffers filled elsewhere,
+// e.g. io_uring provided buffers (feed).
+class MessageReader {
+public:
+    using MessageHandler = std::function<void(MessageType, std::vector<char>&)>;
+
+    MessageReader();
+
+    // Read from a non-blocking socket until EAGAIN, dispatching every
+    // complete message. Returns false once the peer closed or on error.
+    bool readFrom(int fd, const MessageHandler& handler);
+
+    // Consume bytes that were already received
+    void feed(const char* data, size_t len, const MessageHandler& handler);
+
+private:
+    // Where the next bytes go and how many the current state still wants
+    void window(char*& dst, size_t& want);
+    void advance(size_t received, const MessageHandler& handler);
+
+    char header_[sizeof(MessageType) + sizeof(size_t)];
+    size_t headerReceived_;
+    bool readingPayload_;
+    std::vector<char> payload_;
+    size_t payloadReceived_;
+};
+
+// Non-blocking framed connection driven by an event loop.
+// Writes are queued and flushed as the socket drains; an event loop that does
+// its own writes (io_uring) installs a write notifier and drains the outbox
+// with nextOutput/consumeOutput instead.
+class Connection {
+public:
+    using MessageHandler = MessageReader::MessageHandler;
+
+    Connection(int fd, const std::string& peer);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    int fd() const { return fd_; }
+    const std::string& peer() const { return peer_; }
+
+    // Read until EAGAIN, dispatching every complete message.
+    // Returns false once the peer has closed or the socket failed.
+    bool readAvailable(const MessageHandler& handler);
+
+    // Consume bytes received by the event loop on our behalf
+    void feed(const char* data, size_t len, const MessageHandler& handler);
+
+    // Thread-safe: frame a message, queue it and try to write it right away.
+    // Returns false if the connection is already closed.
+    bool queueMessage(MessageType type, const std::vector<char>& payload);
+
+    // Write as much queued output as the socket accepts.
+    // Returns false on a socket error.
+    bool flush();
+
+    // Hand writes to the event loop: queueMessage only queues and calls notify
+    void setWriteNotifier(std::function<void()> notify);
+
+    // Queue a message like queueMessage, then hold back everything queued
+    // after it until releaseOutput, e.g. while the peer switches transports
+    bool queueAndHold(MessageType type, const std::vector<char>& payload);
+
+    // Queue the held messages for whichever writer is in charge now
+    void releaseOutput();
+
+    // External writer interface: the unsent part of the oldest message, and
+    // how many bytes of it the loop managed to write
+    bool nextOutput(const char*& data, size_t& len);
+    void consumeOutput(size_t written);
+
+    // Copy as much queued output as fits into dst without consuming it, so
+    // several small messages go out in one write
+    size_t gatherOutput(char* dst, size_t capacity);
+
+    // Stop accepting new output and shut the socket down once the outbox
+    // is drained; the owning loop then sees EOF and closes the connection
+    void closeAfterFlush();
+
+    // Closes the socket; further queueMessage calls are dropped
+    void markClosed();
+    bool closed() const { return closed_; }
+
+    // Link to the peer: the kernel's smoothed TCP round trip, and the rate
+    // at which large bursts of output drained (until one has, cwnd / RTT).
+    // Both are 0 when unknown, e.g. on unix sockets.
+    double rttMs() const;
+    double sendRate() const;  // bytes/s
+
+private:
+    bool queue(MessageType type, const std::vector<char>& payload, bool hold);
+    bool flushLocked();
+    void dropWritten(size_t written);
+    void shutdownIfDrained();
+
+    int fd_;
+    std::string peer_;
+    std::atomic<bool> closed_;
+
+    MessageReader reader_;
+
+    // Write queue, shared with threads that reply on this connection
+    std::mutex writeMutex_;
+    std::deque<std::vector<char>> outbox_;
+    size_t frontOffset_;
+    bool closeAfterFlush_;
+    std::function<void()> writeNotifier_;
+    bool holding_;
+    std::deque<std::vector<char>> held_;  // Queued while holding_
+
+    // Output burst being timed: from the outbox filling to it draining
+    std::chrono::steady_clock::time_point burstStart_;
+    size_t burstBytes_;
+    std::atomic<double> drainRate_;  // Smoothed bytes/s, 0 until sampled
+};
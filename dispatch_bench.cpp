@@ -0,0 +1,119 @@
+#include "master.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Request-handler throughput: N clients ask the master for tasks at once
+// and hand each one straight back, through assignTasks, the performance
+// update and processResult, with no sockets or compute in between. Unlike
+// queue_bench this covers the whole dispatch path and its locks: the job
+// and client bookkeeping, walk selection and load balancing.
+
+// Tasks a client asks for per request, and the prefetch depth it claims
+static const int CREDITS = 8;
+static const int PREFETCH_DEPTH = 4096;
+
+struct DispatchBench {
+    // Thousands of tasks dispatched and returned per second with `threads`
+    // concurrent requesters on a size x depth by depth x size job
+    static double measure(int size, int depth, int threads, int& tasksRun, int& tileSize) {
+        Master master(0);
+
+        // Socket pairs stand in for the connections; nothing is ever sent
+        std::vector<std::shared_ptr<Connection>> conns;
+        std::vector<int> peers;
+        for (int t = 0; t < threads; t++) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+                std::cerr << "socketpair failed\n";
+                return 0;
+            }
+            auto conn = std::make_shared<Connection>(fds[0], "bench-" + std::to_string(t));
+            conn->setWriteNotifier([]() {});
+            peers.push_back(fds[1]);
+
+            // Tiny and slow, so tiles come out small and plentiful
+            Capabilities caps = {};
+            caps.protocolVersion = PROTOCOL_VERSION;
+            caps.cores = 1;
+            caps.prefetchDepth = PREFETCH_DEPTH;
+            caps.dtypes = DTYPE_F64;
+            caps.codecs = CODEC_RAW;
+            caps.clockGHz = 1;
+            caps.gflops = 0.001;
+            caps.memoryBytes = 1ull << 40;
+            master.welcomeClient(conn, NetworkMessage::serializeCapabilities(caps));
+            conns.push_back(conn);
+        }
+
+        Matrix a(size, depth), b(depth, size);
+        int jobId = master.submitJob(a, b);
+        tileSize = master.findJob(jobId)->tileSize;
+
+        std::atomic<int> dispatched(0);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&master, &dispatched, jobId, conn = conns[t]]() {
+                while (!master.isComplete(jobId)) {
+                    std::vector<Task> tasks = master.assignTasks(conn->fd(), CREDITS);
+                    if (tasks.empty()) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    for (const Task& task : tasks) {
+                        Result result = {task.taskId, task.jobId, task.startRow, task.endRow,
+                                         task.startCol, task.endCol, task.startK, task.endK,
+                                         std::vector<double>((size_t)(task.endRow - task.startRow) *
+                                                             (task.endCol - task.startCol)),
+                                         1.0, 0, false};
+                        master.updateClientPerformance(conn, result);
+                        master.processResult(result, conn->fd());
+                    }
+                    dispatched += tasks.size();
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (int peer : peers) {
+            close(peer);
+        }
+        tasksRun = dispatched;
+        return dispatched / seconds / 1e3;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    int size = (argc > 1) ? std::stoi(argv[1]) : 2048;
+    int depth = (argc > 2) ? std::stoi(argv[2]) : 16;
+    int maxThreads = (argc > 3) ? std::stoi(argv[3]) : (int)std::max(std::thread::hardware_concurrency(), 2u);
+
+    std::cout << "Dispatching a " << size << "x" << depth << " by " << depth << "x" << size
+              << " job (Ktasks/s)\n";
+    std::cout << std::setw(8) << "threads" << std::setw(8) << "tile" << std::setw(10) << "tasks"
+              << std::setw(12) << "Ktasks/s" << "\n";
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        // The master logs every client and result; keep that out of the way
+        std::streambuf* console = std::cout.rdbuf(nullptr);
+        std::streambuf* errors = std::cerr.rdbuf(nullptr);
+        int tasks = 0, tile = 0;
+        double rate = DispatchBench::measure(size, depth, threads, tasks, tile);
+        std::cout.rdbuf(console);
+        std::cerr.rdbuf(errors);
+
+        std::cout << std::setw(8) << threads << std::setw(8) << tile << std::setw(10) << tasks
+                  << std::fixed << std::setprecision(1) << std::setw(12) << rate << "\n";
+    }
+    return 0;
+}
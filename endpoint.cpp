@@ -0,0 +1,111 @@
+#include "endpoint.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+
+Endpoint Endpoint::tcp(const std::string& host, int port) {
+    Endpoint endpoint;
+    endpoint.kind = ENDPOINT_TCP;
+    endpoint.host = host;
+    endpoint.port = port;
+    endpoint.abstract = false;
+    return endpoint;
+}
+
+static bool parsePort(const std::string& text, int& port) {
+    if (text.empty() || text.size() > 5) {
+        return false;
+    }
+    for (char c : text) {
+        if (!isdigit((unsigned char)c)) {
+            return false;
+        }
+    }
+    port = std::stoi(text);
+    return port > 0 && port < 65536;
+}
+
+bool Endpoint::parse(const std::string& text, Endpoint& endpoint) {
+    static const std::string unixPrefix = "unix:";
+
+    if (text.compare(0, unixPrefix.size(), unixPrefix) == 0) {
+        std::string path = text.substr(unixPrefix.size());
+        endpoint.kind = ENDPOINT_UNIX;
+        endpoint.abstract = !path.empty() && path[0] == '@';
+        endpoint.path = endpoint.abstract ? path.substr(1) : path;
+        endpoint.port = 0;
+        endpoint.host.clear();
+
+        // sun_path holds the name plus a NUL (or the leading NUL when abstract)
+        return !endpoint.path.empty() && endpoint.path.size() < sizeof(((struct sockaddr_un*)nullptr)->sun_path);
+    }
+
+    size_t colon = text.rfind(':');
+    std::string host = (colon == std::string::npos) ? "" : text.substr(0, colon);
+    std::string port = (colon == std::string::npos) ? text : text.substr(colon + 1);
+
+    endpoint = tcp(host, 0);
+    return parsePort(port, endpoint.port);
+}
+
+std::string Endpoint::toString() const {
+    if (kind == ENDPOINT_UNIX) {
+        return std::string("unix:") + (abstract ? "@" : "") + path;
+    }
+    return (host.empty() ? "*" : host) + ":" + std::to_string(port);
+}
+
+socklen_t Endpoint::toSockaddr(struct sockaddr_storage& addr) const {
+    std::memset(&addr, 0, sizeof(addr));
+
+    if (kind == ENDPOINT_UNIX) {
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&addr);
+        un->sun_family = AF_UNIX;
+        if (abstract) {
+            // Abstract names start with a NUL and are not NUL-terminated
+            std::memcpy(un->sun_path + 1, path.data(), path.size());
+            return offsetof(struct sockaddr_un, sun_path) + 1 + path.size();
+        }
+        std::memcpy(un->sun_path, path.data(), path.size());
+        return sizeof(struct sockaddr_un);
+    }
+
+    struct sockaddr_in* in = reinterpret_cast<struct sockaddr_in*>(&addr);
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    if (host.empty()) {
+        in->sin_addr.s_addr = INADDR_ANY;
+    } else if (inet_pton(AF_INET, host.c_str(), &in->sin_addr) <= 0) {
+        return 0;
+    }
+    return sizeof(struct sockaddr_in);
+}
+
+bool Endpoint::removeSocketFile() const {
+    if (kind != ENDPOINT_UNIX || abstract) {
+        return true;
+    }
+    struct stat st;
+    if (lstat(path.c_str(), &st) < 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        return false;
+    }
+    return unlink(path.c_str()) == 0 || errno == ENOENT;
+}
+
+std::string Endpoint::peerName(int sockfd) {
+    struct sockaddr_storage addr;
+    socklen_t addrLen = sizeof(addr);
+    std::memset(&addr, 0, sizeof(addr));
+    getpeername(sockfd, (struct sockaddr*)&addr, &addrLen);
+
+    if (addr.ss_family == AF_INET) {
+        return inet_ntoa(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_addr);
+    }
+
+    // Unix clients are anonymous; tell them apart by descriptor
+    return "unix#" + std::to_string(sockfd);
+}
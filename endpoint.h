@@ -0,0 +1,40 @@
+#pragma once
+#include "common.h"
+#include <sys/un.h>
+
+// Address the master listens on and clients connect to:
+//   host:port    TCP (host may be omitted on the master to listen on all interfaces)
+//   port         TCP, shorthand for :port
+//   unix:/path   Unix domain socket bound to a filesystem path
+//   unix:@name   Linux abstract-namespace socket (no file, gone with the process)
+struct Endpoint {
+    enum Kind {
+        ENDPOINT_TCP,
+        ENDPOINT_UNIX
+    };
+
+    Kind kind;
+    std::string host;   // TCP: dotted address, empty for any
+    int port;           // TCP
+    std::string path;   // Unix: path, or name without the '@' when abstract
+    bool abstract;
+
+    static Endpoint tcp(const std::string& host, int port);
+
+    // Returns false for malformed text
+    static bool parse(const std::string& text, Endpoint& endpoint);
+
+    std::string toString() const;
+    int family() const { return kind == ENDPOINT_UNIX ? AF_UNIX : AF_INET; }
+
+    // Socket address for bind/connect; returns its length, 0 if invalid
+    socklen_t toSockaddr(struct sockaddr_storage& addr) const;
+
+    // Remove the socket file a Unix endpoint left behind. True if the path
+    // is free now; false, leaving it alone, if something other than a
+    // socket is there.
+    bool removeSocketFile() const;
+
+    // Printable name of a connected peer (the address for TCP)
+    static std::string peerName(int sockfd);
+};
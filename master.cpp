@@ -1,11 +1,115 @@
 #include "master.h"
+#include "uring.h"
 #include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <cstring>
+#include <functional>
+#include <immintrin.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <tuple>
+
+// Events handled per epoll_wait call
+static const int MAX_EPOLL_EVENTS = 64;
+
+// io_uring loop sizing: submission entries, provided receive buffers and
+// registered send slots per I/O thread
+static const unsigned URING_ENTRIES = 256;
+static const unsigned URING_RECV_BUFFERS = 128;
+static const unsigned URING_RECV_BUFFER_SIZE = 64 * 1024;
+static const unsigned URING_SEND_SLOTS = 32;
+static const size_t URING_SEND_SLOT_SIZE = 256 * 1024;
+
+// io_uring user_data: connection id in the high bits, operation in the low byte
+enum UringOp
+{
+    URING_OP_ACCEPT = 1,
+    URING_OP_RECV = 2,
+    URING_OP_SEND = 3,
+    URING_OP_NOTIFY = 4,
+    URING_OP_WAKE = 5
+};
+
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static bool sameMatrix(const Matrix &a, const Matrix &b)
+{
+    return a.rows() == b.rows() && a.cols() == b.cols() &&
+           std::memcmp(a.data(), b.data(), (size_t)a.rows() * a.cols() * sizeof(double)) == 0;
+}
+
+// dst[0, n) += src[0, n), four doubles at a time
+static void addRow(double *dst, const double *src, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(dst + i), _mm256_loadu_pd(src + i)));
+    for (; i < n; i++)
+        dst[i] += src[i];
+}
+
+// A load index entry in one word, so the balancer reads it whole: the load
+// as a float in the high half, the socket in the low half
+static uint64_t packLoad(double load, int clientSocket)
+{
+    float value = (float)load;
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (uint64_t)bits << 32 | (uint32_t)clientSocket;
+}
+
+static int unpackLoad(uint64_t packed, double &load)
+{
+    uint32_t bits = (uint32_t)(packed >> 32);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    load = value;
+    return (int)(uint32_t)packed;
+}
+
+// The blocks of `source` (cut by tileEnd's rule) that SUMMA grid position
+// (row, col) owns, packed row-major: block rows row, row + procRows, ...
+// and block columns col, col + procCols, ...
+static SummaData packCyclic(const Matrix &source, int edge, int procRows, int row, int procCols, int col)
+{
+    SummaData piece = {0, 0, 0, cyclicExtent(source.rows(), edge, procRows, row),
+                       cyclicExtent(source.cols(), edge, procCols, col), {}};
+    piece.data.reserve((size_t)piece.rows * piece.cols);
+    for (int bi = row; bi < tileCount(edge, source.rows()); bi += procRows)
+    {
+        for (int r = bi * edge; r < tileEnd(bi * edge, edge, source.rows()); r++)
+        {
+            for (int bj = col; bj < tileCount(edge, source.cols()); bj += procCols)
+            {
+                const double *from = &source.at(r, bj * edge);
+                piece.data.insert(piece.data.end(), from, from + (tileEnd(bj * edge, edge, source.cols()) - bj * edge));
+            }
+        }
+    }
+    return piece;
+}
 
-Master::Master(int port)
-    : port_(port), running_(false), computationStarted_(false),
-      matrixA_(1, 1), matrixB_(1, 1), resultMatrix_(1, 1),
-      nextTaskId_(0), completedTasks_(0), totalTasks_(0) {}
+Master::Master(int port, int ioThreads)
+    : Master(Endpoint::tcp("", port), ioThreads) {}
+
+Master::Master(const Endpoint &endpoint, int ioThreads)
+    : endpoint_(endpoint), running_(false),
+      operandMode_(OPERANDS_ON_DEMAND), scheduleMode_(SCHEDULE_STATIC), tileOrder_(TILE_ORDER_ROWS),
+      nextJobId_(0), nextVersion_(0),
+      ioThreadCount_(std::max(ioThreads, 1)), ioBackend_(IO_BACKEND_EPOLL), wakeupFd_(-1),
+      shmSleeping_(false), shmGeneration_(0), nextChannel_(0), requestsParked_(false), indexedClients_(0)
+{
+    lightest_[0] = lightest_[1] = packLoad(0, -1);
+}
 
 Master::~Master()
 {
@@ -14,25 +118,33 @@ Master::~Master()
 
 void Master::start()
 {
-    serverSocket_ = socket(AF_INET, SOCK_STREAM, 0);
+    serverSocket_ = socket(endpoint_.family(), SOCK_STREAM, 0);
     if (serverSocket_ < 0)
     {
         std::cerr << "Error creating socket\n";
         return;
     }
 
-    // Enable address reuse
-    int opt = 1;
-    setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (endpoint_.kind == Endpoint::ENDPOINT_TCP)
+    {
+        // Enable address reuse
+        int opt = 1;
+        setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    }
+    else if (!endpoint_.removeSocketFile())
+    {
+        // A socket file left behind by an earlier run would make bind
+        // fail; anything else at that path is not ours to remove
+        std::cerr << "Error binding socket: " << endpoint_.path << " exists and is not a socket\n";
+        close(serverSocket_);
+        return;
+    }
 
     // Bind socket
-    struct sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(port_);
+    struct sockaddr_storage serverAddr;
+    socklen_t serverAddrLen = endpoint_.toSockaddr(serverAddr);
 
-    if (bind(serverSocket_, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0)
+    if (serverAddrLen == 0 || bind(serverSocket_, (struct sockaddr *)&serverAddr, serverAddrLen) < 0)
     {
         std::cerr << "Error binding socket\n";
         close(serverSocket_);
@@ -40,21 +152,71 @@ void Master::start()
     }
 
     // Listen for connections
-    if (listen(serverSocket_, 10) < 0)
+    if (listen(serverSocket_, SOMAXCONN) < 0 || !setNonBlocking(serverSocket_))
     {
         std::cerr << "Error listening\n";
         close(serverSocket_);
         return;
     }
 
+    wakeupFd_ = eventfd(0, EFD_NONBLOCK);
+    if (wakeupFd_ < 0)
+    {
+        std::cerr << "Error creating wakeup eventfd\n";
+        close(serverSocket_);
+        return;
+    }
+
+    if (ioBackend_ == IO_BACKEND_URING && !IoUring::available())
+    {
+        std::cerr << "io_uring unavailable, falling back to epoll\n";
+        ioBackend_ = IO_BACKEND_EPOLL;
+    }
+
     running_ = true;
-    std::cout << "Master server started on port " << port_ << std::endl;
+    std::cout << "Master server started on " << endpoint_.toString() << " ("
+              << ioBackendName(ioBackend_) << " I/O)" << std::endl;
     std::cout << "Waiting for clients to connect...\n";
     std::cout << "Connected clients: 0\n";
 
-    // Start accepting client connections in a separate thread
-    std::thread acceptThread(&Master::acceptConnections, this);
-    acceptThread.detach();
+    // Start the I/O threads; each one accepts and serves its own clients
+    for (int i = 0; i < ioThreadCount_; i++)
+    {
+        if (ioBackend_ == IO_BACKEND_URING)
+        {
+            ioThreads_.emplace_back(&Master::uringLoop, this);
+            continue;
+        }
+
+        int epollFd = epoll_create1(0);
+        if (epollFd < 0)
+        {
+            std::cerr << "Error creating epoll instance\n";
+            continue;
+        }
+
+        // Level-triggered and exclusive so one thread wakes per new client
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.fd = serverSocket_;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket_, &ev);
+
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeupFd_;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd_, &ev);
+
+        ioThreads_.emplace_back(&Master::ioLoop, this, epollFd);
+    }
+
+    shmThread_ = std::thread(&Master::shmLoop, this);
+    leaseThread_ = std::thread(&Master::leaseLoop, this);
+}
+
+void Master::setIoBackend(IoBackend backend)
+{
+    // The master never blocks on a single client; "blocking" means epoll here
+    ioBackend_ = (backend == IO_BACKEND_URING) ? IO_BACKEND_URING : IO_BACKEND_EPOLL;
 }
 
 void Master::stop()
@@ -62,387 +224,2569 @@ void Master::stop()
     if (!running_)
         return;
 
-    running_ = false;
-    close(serverSocket_);
+    // Send shutdown to all clients; the owning loops close them on exit
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        for (auto &client : connections_)
+        {
+            client.second->queueMessage(SHUTDOWN, {});
+        }
+    }
 
-    // Wake up any waiting threads
-    taskCV_.notify_all();
+    running_ = false;
 
-    // Send shutdown to all clients
-    std::lock_guard<std::mutex> lock(clientsMutex_);
-    for (auto &client : clientThreads_)
+    // Wake up the I/O threads
+    uint64_t one = 1;
+    if (write(wakeupFd_, &one, sizeof(one)) < 0)
     {
-        NetworkMessage::sendMessage(client.first, SHUTDOWN, {});
-        client.second.join();
+        std::cerr << "Error waking I/O threads\n";
     }
-    clientThreads_.clear();
-}
 
-void Master::startComputation()
-{
-    if (computationStarted_)
+    wakeShmLoop();
     {
-        std::cerr << "Computation already started\n";
-        return;
+        std::lock_guard<std::mutex> lock(leaseWakeMutex_);
+        leaseWake_.notify_all();
     }
-
-    // Lock to check if we have clients
     {
-        std::lock_guard<std::mutex> lock(clientsMutex_);
-        if (clientThreads_.empty())
-        {
-            std::cerr << "No clients connected. Cannot start computation.\n";
-            return;
-        }
+        std::lock_guard<std::mutex> lock(jobDoneMutex_);
+        jobDone_.notify_all();
+    }
 
-        std::cout << "Starting computation with " << clientThreads_.size() << " connected clients\n";
+    for (auto &thread : ioThreads_)
+    {
+        thread.join();
     }
+    ioThreads_.clear();
+    if (shmThread_.joinable())
+        shmThread_.join();
+    if (leaseThread_.joinable())
+        leaseThread_.join();
 
-    // Set computation flag
-    computationStarted_ = true;
+    close(serverSocket_);
+    close(wakeupFd_);
 
-    // Notify all waiting clients that computation has started
-    taskCV_.notify_all();
+    endpoint_.removeSocketFile();
 }
 
-void Master::setMatrices(const Matrix &a, const Matrix &b)
+int Master::submitJob(const Matrix &a, const Matrix &b, int priority, double weight)
 {
     // Verify matrices can be multiplied
     if (a.cols() != b.rows())
     {
         std::cerr << "Invalid matrix dimensions for multiplication\n";
-        return;
+        return -1;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->priority = priority;
+    job->weight = weight > 0 ? weight : 1.0;
+    job->scheduleMode = scheduleMode_;
+    job->tileOrder = tileOrder_;
+    job->a = a;
+    job->b = b;
+    job->result = Matrix(a.rows(), b.cols());
+
+    // Column panels of B are served from its transpose
+    job->bt = Matrix(b.cols(), b.rows());
+    for (int i = 0; i < b.rows(); i++)
+    {
+        for (int j = 0; j < b.cols(); j++)
+        {
+            job->bt.at(j, i) = b.at(i, j);
+        }
+    }
+
+    // Size tiles for the clients that are here now
+    job->tileSize = chooseTileSize(*job, job->sliceDepth);
+
+    // Operands the previous job used as well, cut the same way, keep their
+    // version, and the panels clients cached for them
+    std::shared_ptr<Job> previous = std::atomic_load(&lastJob_);
+    bool sameTiling = previous && previous->tileSize == job->tileSize && previous->sliceDepth == job->sliceDepth;
+    bool keepA = sameTiling && sameMatrix(previous->a, a);
+    bool keepB = sameTiling && sameMatrix(previous->b, b);
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        job->id = ++nextJobId_;
+        job->shmName = shmName("j" + std::to_string(job->id));
+        job->versionA = keepA ? previous->versionA : ++nextVersion_;
+        job->versionB = keepB ? previous->versionB : ++nextVersion_;
+
+        // The relay tree carries one job's operands at a time, so only a
+        // job running alone is broadcast; others are served as panels
+        bool alone = std::none_of(jobs_.begin(), jobs_.end(), [](const auto &entry)
+                                  { return !entry.second->finished; });
+        job->broadcast = (operandMode_ == OPERANDS_BROADCAST && alone);
+    }
+
+    std::cout << "Job " << job->id << " (priority " << job->priority << ", weight " << job->weight << ") uses "
+              << job->tileSize << "x" << job->tileSize << " tiles";
+    if (job->sliceDepth > 0)
+        std::cout << ", inner dimension in slices of " << job->sliceDepth;
+    std::cout << "\n";
+    createTiledTasks(*job);
+
+    std::vector<std::pair<std::shared_ptr<Connection>, int>> parked;
+    {
+        std::lock_guard<std::mutex> lock(taskMutex_);
+
+        // Announce the job ahead of its tasks; local clients map its segment
+        std::vector<char> jobStart = NetworkMessage::serializeJobStart(job->id, job->shmFailed ? "" : job->shmName);
+        {
+            std::lock_guard<std::mutex> clientsLock(clientsMutex_);
+            for (auto &client : connections_)
+            {
+                client.second->queueMessage(JOB_START, jobStart);
+            }
+        }
+
+        // Open the job for dispatch and take the requests waiting for one
+        {
+            std::lock_guard<std::mutex> perfLock(perfMutex_);
+
+            // A newcomer starts level with the least served job running, so
+            // it neither waits behind the others nor starves them
+            std::set<int> versions = {job->versionA, job->versionB};
+            bool first = true;
+            for (auto &[id, other] : jobs_)
+            {
+                if (other->finished)
+                    continue;
+                job->served = first ? other->served.load() : std::min(job->served.load(), other->served.load());
+                first = false;
+                versions.insert(other->versionA);
+                versions.insert(other->versionB);
+            }
+            jobs_[job->id] = job;
+            std::atomic_store(&lastJob_, job);
+
+            // Forget panels of operand versions no running job names
+            for (auto &[fd, info] : clientPerformance_)
+            {
+                std::lock_guard<std::mutex> clientLock(info->mutex);
+                for (auto it = info->panelsHeld.begin(); it != info->panelsHeld.end();)
+                {
+                    if (versions.count((int)(*it >> 40)))
+                        ++it;
+                    else
+                        it = info->panelsHeld.erase(it);
+                }
+                reindexLoad(fd, *info);
+            }
+        }
+        parked.swap(parkedRequests_);
+        requestsParked_ = false;
     }
 
-    matrixA_ = a;
-    matrixB_ = b;
-    resultMatrix_ = Matrix(a.rows(), b.cols());
+    // Get A and B to every client that does not map them already
+    if (job->broadcast)
+        broadcastOperands(*job);
+
+    if (job->scheduleMode == SCHEDULE_SUMMA)
+        startSumma(*job);
 
-    // Create tiled tasks
-    createTiledTasks();
+    // Answer clients that were waiting for work
+    for (auto &[conn, credits] : parked)
+    {
+        replyWithTasks(conn, credits);
+    }
+    return job->id;
 }
 
-void Master::createTiledTasks()
+void Master::createTiledTasks(Job &job)
 {
-    int rows = matrixA_.rows();
-    int cols = matrixB_.cols();
-    int common = matrixA_.cols(); // = matrixB_.rows()
+    int rows = job.a.rows();
+    int cols = job.b.cols();
+    int common = job.a.cols(); // = b.rows()
 
     // Calculate number of tiles in each dimension
-    int rowTiles = (rows + TILE_SIZE - 1) / TILE_SIZE;
-    int colTiles = (cols + TILE_SIZE - 1) / TILE_SIZE;
-
-    // Reset counters
-    totalTasks_ = 0;
-    completedTasks_ = 0;
-    nextTaskId_ = 0;
+    int rowTiles = tileCount(job.tileSize, rows);
+    int colTiles = tileCount(job.tileSize, cols);
+
+    // The job is not published yet, so nothing else touches its queues.
+    // Slower clients split tiles as they take them, and guided chunks go
+    // down to strips of MIN_TILE_SIZE rows, so leave room for every piece.
+    size_t tiles = (size_t)rowTiles * colTiles;
+    bool guided = (job.scheduleMode == SCHEDULE_GUIDED);
+    bool summa = (job.scheduleMode == SCHEDULE_SUMMA);
+
+    // Static jobs may cut the inner dimension too; every tile then has a
+    // task per slice, summed on arrival
+    job.kSlices = (job.scheduleMode == SCHEDULE_STATIC && job.sliceDepth > 0 && job.sliceDepth < common)
+                      ? tileCount(job.sliceDepth, common)
+                      : 1;
+    job.gridTasks = guided ? 0 : (int)(tiles * job.kSlices);
+    job.taskDone.assign(job.gridTasks, 0);
+    job.cellsLeft = guided ? (long long)rows * cols : 0;
+    job.summaTiles.assign(summa ? tiles : 0, Task());
+
+    // Cut the grid, in the chosen order, into walks
+    job.tileSequence = enumerateTiles(job.tileOrder, rowTiles, colTiles);
+    job.gridCols = colTiles;
+    int length = walkLength(job.tileOrder, colTiles);
+    job.walks.assign((tiles + length - 1) / length, Walk());
+    job.tileWalk.assign(tiles, 0);
+    for (size_t n = 0; n < job.tileSequence.size(); n++)
+    {
+        auto [i, j] = job.tileSequence[n];
+        Walk &walk = job.walks[n / length];
+        job.tileWalk[(size_t)i * colTiles + j] = (int)(n / length);
+        if (std::find(walk.panelsA.begin(), walk.panelsA.end(), i) == walk.panelsA.end())
+            walk.panelsA.push_back(i);
+        if (std::find(walk.panelsB.begin(), walk.panelsB.end(), j) == walk.panelsB.end())
+            walk.panelsB.push_back(j);
+    }
+    job.walkers.reset(new std::atomic<int>[job.walks.size()]());
 
-    std::lock_guard<std::mutex> lock(taskMutex_);
+    size_t walkCapacity = (size_t)length * job.kSlices * MAX_TILE_SPLIT * MAX_TILE_SPLIT;
+    for (size_t w = 0; w < job.walks.size(); w++)
+        job.walkQueues.emplace_back(new MpmcQueue<Task>(walkCapacity));
 
-    // Create tasks for each tile
-    for (int i = 0; i < rowTiles; i++)
+    // Guided jobs queue nothing up front: requests carve their chunks, and
+    // the queue only takes tasks handed back. One task stands in for all
+    // not yet carved, so the job cannot complete before they are.
+    if (guided)
     {
-        int startRow = i * TILE_SIZE;
-        int endRow = std::min(startRow + TILE_SIZE, rows);
+        job.totalTasks = 1;
+        std::cout << "Guided scheduling of job " << job.id << " over " << tiles << " tiles in "
+                  << tileOrderName(job.tileOrder) << " order" << std::endl;
+        return;
+    }
 
-        for (int j = 0; j < colTiles; j++)
+    // Create tasks for each tile, in walk order. SUMMA jobs keep them for
+    // startSumma(), which queues those no grid member takes on. A split
+    // walk goes slice by slice, so consecutive tasks share A's panel slice.
+    for (size_t walkStart = 0; walkStart < job.tileSequence.size(); walkStart += length)
+    {
+        size_t walkEnd = std::min(walkStart + length, job.tileSequence.size());
+        for (int slice = 0; slice < job.kSlices; slice++)
         {
-            Task task;
-            task.taskId = nextTaskId_++;
-            task.startRow = startRow;
-            task.endRow = endRow;
-            task.startCol = j * TILE_SIZE;
-            task.endCol = std::min(task.startCol + TILE_SIZE, cols);
-            task.matrixSize = common;
-
-            taskQueue_.push(task);
-            totalTasks_++;
+            for (size_t n = walkStart; n < walkEnd; n++)
+            {
+                auto [i, j] = job.tileSequence[n];
+                Task task;
+                task.taskId = job.nextTaskId++;
+                task.startRow = i * job.tileSize;
+                task.endRow = tileEnd(task.startRow, job.tileSize, rows);
+                task.startCol = j * job.tileSize;
+                task.endCol = tileEnd(task.startCol, job.tileSize, cols);
+                task.matrixSize = common;
+                task.panelA = i;
+                task.panelB = j;
+                task.jobId = job.id;
+                task.versionA = job.versionA;
+                task.versionB = job.versionB;
+                task.startK = (job.kSlices > 1) ? slice * job.sliceDepth : 0;
+                task.endK = (job.kSlices > 1) ? tileEnd(task.startK, job.sliceDepth, common) : common;
+                task.slice = slice;
+
+                if (summa)
+                    job.summaTiles[(size_t)i * colTiles + j] = task;
+                else
+                    queueTask(job, task);
+                job.totalTasks++;
+            }
         }
     }
 
-    std::cout << "Created " << totalTasks_ << " tiled tasks" << std::endl;
+    std::cout << "Created " << job.totalTasks << " tiled tasks for job " << job.id << " in "
+              << job.walks.size() << " " << tileOrderName(job.tileOrder) << " walks";
+    if (job.kSlices > 1)
+        std::cout << ", inner dimension in " << job.kSlices << " slices";
+    std::cout << std::endl;
+}
+
+std::shared_ptr<Master::Job> Master::findJob(int jobId) const
+{
+    std::lock_guard<std::mutex> lock(perfMutex_);
+    auto it = jobs_.find(jobId);
+    return it != jobs_.end() ? it->second : nullptr;
+}
+
+bool Master::isComplete(int jobId) const
+{
+    std::shared_ptr<Job> job = findJob(jobId);
+    return job && job->finished;
 }
 
-bool Master::isComplete() const
+bool Master::waitForJob(int jobId)
 {
-    return completedTasks_ >= totalTasks_ && computationStarted_;
+    std::shared_ptr<Job> job = findJob(jobId);
+    if (!job)
+        return false;
+
+    std::unique_lock<std::mutex> lock(jobDoneMutex_);
+    jobDone_.wait(lock, [this, &job]() { return job->finished || !running_; });
+    return job->finished;
 }
 
-Matrix Master::getResult() const
+Matrix Master::takeResult(int jobId)
 {
-    return resultMatrix_;
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        auto it = jobs_.find(jobId);
+        if (it == jobs_.end() || !it->second->finished)
+        {
+            std::cerr << "Job " << jobId << " has no result to take\n";
+            return Matrix(1, 1);
+        }
+        job = it->second;
+        jobs_.erase(it);
+    }
+
+    // Every tile has landed; nothing writes the result any more
+    return std::move(job->result);
 }
 
 int Master::getClientCount() const
 {
     std::lock_guard<std::mutex> lock(clientsMutex_);
-    return clientThreads_.size();
+    return connections_.size();
 }
 
-void Master::acceptConnections()
+void Master::ioLoop(int epollFd)
 {
+    // Connections accepted by this thread; only this thread reads from them
+    std::map<int, std::shared_ptr<Connection>> owned;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
     while (running_)
     {
-        struct sockaddr_in clientAddr;
-        socklen_t clientAddrLen = sizeof(clientAddr);
+        int count = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "epoll_wait failed\n";
+            break;
+        }
 
-        int clientSocket = accept(serverSocket_, (struct sockaddr *)&clientAddr, &clientAddrLen);
-        if (clientSocket < 0)
+        for (int i = 0; i < count && running_; i++)
         {
-            if (running_)
+            int fd = events[i].data.fd;
+
+            if (fd == serverSocket_)
             {
-                std::cerr << "Error accepting connection\n";
+                acceptConnections(epollFd, owned);
+                continue;
             }
-            continue;
-        }
+            if (fd == wakeupFd_)
+                continue;
 
-        std::cout << "New client connected: " << inet_ntoa(clientAddr.sin_addr) << std::endl;
+            auto it = owned.find(fd);
+            if (it == owned.end())
+                continue;
+            std::shared_ptr<Connection> conn = it->second;
 
-        // Create a thread to handle this client
-        std::thread clientThread(&Master::handleClient, this, clientSocket, clientAddr);
+            // Edge-triggered: drain everything the socket has for us
+            bool alive = !(events[i].events & EPOLLERR);
+            if (alive && (events[i].events & EPOLLOUT))
+            {
+                alive = conn->flush();
+            }
+            if (alive && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)))
+            {
+                alive = conn->readAvailable([this, &conn](MessageType type, std::vector<char> &payload)
+                                            { handleMessage(conn, type, payload); });
+            }
 
-        {
-            std::lock_guard<std::mutex> lock(clientsMutex_);
-            clientThreads_[clientSocket] = std::move(clientThread);
-            std::cout << "Connected clients: " << clientThreads_.size() << std::endl;
+            if (!alive || conn->closed())
+            {
+                owned.erase(fd);
+                closeConnection(epollFd, conn);
+            }
         }
     }
+
+    // Shutting down: close whatever this thread still owns
+    for (auto &[fd, conn] : owned)
+    {
+        conn->flush();
+        closeConnection(epollFd, conn);
+    }
+    close(epollFd);
 }
 
-// Modify this function to handle task distribution more efficiently
-void Master::handleClient(int clientSocket, struct sockaddr_in clientAddr)
+void Master::uringLoop()
 {
-
-    // Store the client's IP address for fair distribution tracking
-    std::string clientIp = inet_ntoa(clientAddr.sin_addr);
-
-    // Wait for CPU information
-    auto [msgType, cpuInfoData] = NetworkMessage::receiveMessage(clientSocket);
-
-    if (msgType == CPU_INFO && cpuInfoData.size() >= sizeof(double))
+    IoUring ring;
+    if (!ring.init(URING_ENTRIES) ||
+        !ring.setupBufferRing(0, URING_RECV_BUFFERS, URING_RECV_BUFFER_SIZE))
     {
-        double cpuSpeed;
-        std::memcpy(&cpuSpeed, cpuInfoData.data(), sizeof(double));
-
-        // Store client performance info
-        {
-            std::lock_guard<std::mutex> lock(perfMutex_);
-            clientPerformance_[clientSocket].cpuSpeed = cpuSpeed;
-            clientPerformance_[clientSocket].performanceRatio = cpuSpeed; // Initially based on CPU speed
-        }
-
-        std::cout << "Client " << clientIp << " reported CPU speed: " << cpuSpeed << " GHz\n";
+        std::cerr << "Error setting up io_uring, I/O thread exiting\n";
+        return;
     }
 
-    // Send matrices A and B to the client
-    // std::vector<char> matrixAData = NetworkMessage::serializeMatrix(matrixA_);
-    // NetworkMessage::sendMessage(clientSocket, MATRIX_DATA, matrixAData);
-
-    // std::vector<char> matrixBData = NetworkMessage::serializeMatrix(matrixB_);
-    // NetworkMessage::sendMessage(clientSocket, MATRIX_DATA, matrixBData);
-
-    // Initialize task count for this client
+    // Registered slots that outgoing messages are gathered into
+    std::vector<char> sendSlab(URING_SEND_SLOTS * URING_SEND_SLOT_SIZE);
+    std::vector<struct iovec> slotIovs(URING_SEND_SLOTS);
+    std::vector<int> freeSlots;
+    for (unsigned i = 0; i < URING_SEND_SLOTS; i++)
     {
-        std::lock_guard<std::mutex> lock(taskMutex_);
-        clientTaskCounts_[clientSocket] = 0;
+        slotIovs[i].iov_base = sendSlab.data() + i * URING_SEND_SLOT_SIZE;
+        slotIovs[i].iov_len = URING_SEND_SLOT_SIZE;
+        freeSlots.push_back(i);
     }
+    bool slotsRegistered = ring.registerBuffers(slotIovs.data(), URING_SEND_SLOTS);
 
-    while (running_)
+    // Other threads queue replies on our connections; they record which
+    // ones have output and kick this eventfd
+    struct WriteNotice
+    {
+        int eventFd;
+        std::mutex mutex;
+        std::vector<uint64_t> dirty;
+    };
+    auto notice = std::make_shared<WriteNotice>();
+    notice->eventFd = eventfd(0, EFD_NONBLOCK);
+    uint64_t noticeCounter = 0;
+
+    struct UringConnection
+    {
+        std::shared_ptr<Connection> conn;
+        bool sendInFlight;
+        int slot;      // Registered slot in use, or -1 for a plain send
+        bool closing;  // Waiting for the in-flight send before closing
+    };
+    std::map<uint64_t, UringConnection> owned;  // <connection id, state>
+    uint64_t nextId = 1;
+
+    auto armAccept = [&]()
     {
-        // Receive message from client
-        auto [msgType, payload] = NetworkMessage::receiveMessage(clientSocket);
+        struct io_uring_sqe *sqe = ring.getSqe();
+        if (sqe)
+            IoUring::prepAcceptMultishot(sqe, serverSocket_, URING_OP_ACCEPT);
+    };
+    auto armRecv = [&](uint64_t id, int fd)
+    {
+        struct io_uring_sqe *sqe = ring.getSqe();
+        if (sqe)
+            IoUring::prepRecvMultishot(sqe, fd, 0, (id << 8) | URING_OP_RECV);
+    };
+    auto armNotify = [&]()
+    {
+        struct io_uring_sqe *sqe = ring.getSqe();
+        if (sqe)
+            IoUring::prepRead(sqe, notice->eventFd, &noticeCounter, sizeof(noticeCounter), URING_OP_NOTIFY);
+    };
 
-        if (msgType == TASK_REQUEST)
-        {
-            // Client is asking for work
-            Task task;
-            bool hasTask = false;
+    auto finishClose = [&](uint64_t id)
+    {
+        auto it = owned.find(id);
+        if (it == owned.end())
+            return;
+        std::shared_ptr<Connection> conn = it->second.conn;
+        owned.erase(it);
+        closeConnection(-1, conn);
+    };
+    auto beginClose = [&](uint64_t id)
+    {
+        auto it = owned.find(id);
+        if (it == owned.end() || it->second.closing)
+            return;
 
-            {
-                std::unique_lock<std::mutex> lock(taskMutex_);
+        // Shutting down ends the multishot recv and any in-flight send;
+        // the send buffer must stay alive until its completion arrives
+        shutdown(it->second.conn->fd(), SHUT_RDWR);
+        it->second.closing = true;
+        if (!it->second.sendInFlight)
+            finishClose(id);
+    };
 
-                // Wait until computation has started
-                taskCV_.wait(lock, [this]()
-                             { return computationStarted_ || !running_; });
+    auto startSend = [&](uint64_t id, UringConnection &uc)
+    {
+        if (uc.sendInFlight || uc.closing)
+            return;
 
-                // If we're shutting down, exit
-                if (!running_)
-                    break;
+        struct io_uring_sqe *sqe = nullptr;
+        if (slotsRegistered && !freeSlots.empty())
+        {
+            // Gather several queued messages into one registered buffer
+            int slot = freeSlots.back();
+            char *dst = sendSlab.data() + slot * URING_SEND_SLOT_SIZE;
+            size_t len = uc.conn->gatherOutput(dst, URING_SEND_SLOT_SIZE);
+            if (len == 0 || !(sqe = ring.getSqe()))
+                return;
+            freeSlots.pop_back();
+            IoUring::prepWriteFixed(sqe, uc.conn->fd(), dst, len, slot, (id << 8) | URING_OP_SEND);
+            uc.slot = slot;
+        }
+        else
+        {
+            // Out of slots: send straight from the outbox
+            const char *data;
+            size_t len;
+            if (!uc.conn->nextOutput(data, len) || !(sqe = ring.getSqe()))
+                return;
+            IoUring::prepSend(sqe, uc.conn->fd(), data, len, (id << 8) | URING_OP_SEND);
+            uc.slot = -1;
+        }
+        uc.sendInFlight = true;
+    };
 
-                // Get client task count
-                int &clientTaskCount = clientTaskCounts_[clientSocket];
+    auto onMessage = [this](const std::shared_ptr<Connection> &conn)
+    {
+        return [this, conn](MessageType type, std::vector<char> &payload)
+        { handleMessage(conn, type, payload); };
+    };
 
-                if (!taskQueue_.empty())
-                {
-                    // Get client performance ratio
-                    double perfRatio = 1.0;
-                    {
-                        std::lock_guard<std::mutex> perfLock(perfMutex_);
-                        perfRatio = clientPerformance_[clientSocket].performanceRatio;
-                    }
+    armAccept();
+    armNotify();
+    struct io_uring_sqe *wakeSqe = ring.getSqe();
+    if (wakeSqe)
+        IoUring::prepPoll(wakeSqe, wakeupFd_, POLLIN, URING_OP_WAKE);
+
+    while (running_)
+    {
+        // Queue writes for every connection that has new output
+        std::vector<uint64_t> dirty;
+        {
+            std::lock_guard<std::mutex> lock(notice->mutex);
+            dirty.swap(notice->dirty);
+        }
+        for (uint64_t id : dirty)
+        {
+            auto it = owned.find(id);
+            if (it != owned.end())
+                startSend(id, it->second);
+        }
 
-                    // Check if this client should get a task based on its performance
-                    bool shouldAssignTask = true;
+        // One syscall submits everything queued above and waits for work
+        if (ring.submit(1) < 0 && errno != EBUSY)
+        {
+            std::cerr << "io_uring_enter failed\n";
+            break;
+        }
 
-                    // Only do load balancing if we have multiple clients
-                    if (clientTaskCounts_.size() > 1)
-                    {
-                        // Calculate weighted task count (tasks / performance)
-                        double weightedTaskCount = clientTaskCount / perfRatio;
-
-                        // Check if any client has a higher weighted task count
-                        for (const auto &[otherSocket, otherCount] : clientTaskCounts_)
-                        {
-                            if (otherSocket == clientSocket)
-                                continue;
-
-                            double otherPerfRatio = 1.0;
-                            {
-                                std::lock_guard<std::mutex> perfLock(perfMutex_);
-                                if (clientPerformance_.find(otherSocket) != clientPerformance_.end())
-                                {
-                                    otherPerfRatio = clientPerformance_[otherSocket].performanceRatio;
-                                }
-                            }
-
-                            double otherWeightedCount = otherCount / otherPerfRatio;
-
-                            // If this client already has more work relative to its performance,
-                            // and there are enough tasks for everyone, don't give it more work yet
-                            if (weightedTaskCount > otherWeightedCount &&
-                                taskQueue_.size() <= clientTaskCounts_.size())
-                            {
-                                shouldAssignTask = false;
-                                break;
-                            }
-                        }
-                    }
+        struct io_uring_cqe cqe;
+        while (ring.peekCqe(cqe))
+        {
+            ring.seenCqe();
+            uint64_t id = cqe.user_data >> 8;
+            int op = cqe.user_data & 0xff;
 
-                    if (shouldAssignTask)
+            if (op == URING_OP_ACCEPT)
+            {
+                if (!(cqe.flags & IORING_CQE_F_MORE) && running_)
+                    armAccept();
+                if (cqe.res < 0)
+                    continue;
+
+                uint64_t connId = nextId++;
+                auto conn = registerClient(cqe.res);
+                conn->setWriteNotifier([notice, connId]()
+                                       {
                     {
-                        task = taskQueue_.front();
-                        taskQueue_.pop();
-                        hasTask = true;
-                        clientTaskCount++; // Increment task count for this client
+                        std::lock_guard<std::mutex> lock(notice->mutex);
+                        notice->dirty.push_back(connId);
                     }
-                }
+                    uint64_t one = 1;
+                    if (write(notice->eventFd, &one, sizeof(one)) < 0) {} });
+                owned[connId] = UringConnection{conn, false, -1, false};
+                armRecv(connId, cqe.res);
             }
-
-            if (hasTask)
+            else if (op == URING_OP_RECV)
             {
-                // Send task to client
-                std::vector<char> taskData = NetworkMessage::serializeTask(task);
-                NetworkMessage::sendMessage(clientSocket, TASK_RESPONSE, taskData);
+                auto it = owned.find(id);
+                bool more = cqe.flags & IORING_CQE_F_MORE;
+                bool hasBuffer = cqe.flags & IORING_CQE_F_BUFFER;
+                uint16_t bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
 
-                std::cout << "Assigned task " << task.taskId << " to client "
-                          << clientIp << " (socket " << clientSocket << ")" << std::endl;
+                if (it == owned.end() || it->second.closing)
+                {
+                    if (hasBuffer)
+                        ring.recycleBuffer(bufferId);
+                    continue;
+                }
+                if (cqe.res > 0)
+                {
+                    std::shared_ptr<Connection> conn = it->second.conn;
+                    conn->feed(ring.providedBuffer(bufferId), cqe.res, onMessage(conn));
+                    ring.recycleBuffer(bufferId);
+                    if (!more)
+                        armRecv(id, conn->fd());
+                }
+                else if (cqe.res == -ENOBUFS)
+                {
+                    // All provided buffers were busy; they are back now
+                    armRecv(id, it->second.conn->fd());
+                }
+                else
+                {
+                    beginClose(id);  // EOF or socket error
+                }
             }
-            else if (isComplete())
+            else if (op == URING_OP_SEND)
             {
-                // No more tasks, send shutdown
-                NetworkMessage::sendMessage(clientSocket, SHUTDOWN, {});
-                break;
+                auto it = owned.find(id);
+                if (it == owned.end())
+                    continue;
+                UringConnection &uc = it->second;
+                uc.sendInFlight = false;
+                if (uc.slot >= 0)
+                    freeSlots.push_back(uc.slot);
+
+                if (uc.closing)
+                {
+                    finishClose(id);
+                }
+                else if (cqe.res < 0)
+                {
+                    beginClose(id);
+                }
+                else
+                {
+                    uc.conn->consumeOutput(cqe.res);
+                    startSend(id, uc);  // More may have been queued meanwhile
+                }
             }
-            else
+            else if (op == URING_OP_NOTIFY)
             {
-                // No tasks currently, but computation not complete
-                NetworkMessage::sendMessage(clientSocket, NO_WORK, {});
-
-                // Wait a bit before client retries
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                armNotify();
             }
         }
-        else if (msgType == COMPUTATION_RESULT)
-        {
-            // Received computation result
-            Result result = NetworkMessage::deserializeResult(payload);
+    }
 
-            // Update performance metrics based on execution time
-            updateClientPerformance(clientSocket, result.executionTimeMs);
+    // Shutting down: finish in-flight writes, then push out anything still
+    // queued (e.g. SHUTDOWN from stop()) directly before closing
+    bool inFlight = true;
+    for (int attempts = 0; inFlight && attempts < 100; attempts++)
+    {
+        inFlight = false;
+        for (auto &[id, uc] : owned)
+            inFlight = inFlight || uc.sendInFlight;
+        if (!inFlight || ring.submit(1) < 0)
+            break;
 
-            // Decrement task count when result is received
+        struct io_uring_cqe cqe;
+        while (ring.peekCqe(cqe))
+        {
+            ring.seenCqe();
+            auto it = owned.find(cqe.user_data >> 8);
+            if ((cqe.user_data & 0xff) == URING_OP_SEND && it != owned.end())
             {
-                std::lock_guard<std::mutex> lock(taskMutex_);
-                clientTaskCounts_[clientSocket]--;
+                it->second.sendInFlight = false;
+                if (cqe.res > 0)
+                    it->second.conn->consumeOutput(cqe.res);
             }
-
-            processResult(result);
-        }
-        else if (msgType == CLIENT_DISCONNECT)
-        {
-            // Client is disconnecting
-            std::cout << "Client disconnected: " << clientIp << std::endl;
-            break;
         }
     }
+    for (auto &[id, uc] : owned)
+    {
+        uc.conn->setWriteNotifier(nullptr);
+        uc.conn->flush();
+        shutdown(uc.conn->fd(), SHUT_RDWR);
+        closeConnection(-1, uc.conn);
+    }
+    close(notice->eventFd);
+}
 
-    close(clientSocket);
-
+void Master::acceptConnections(int epollFd, std::map<int, std::shared_ptr<Connection>> &owned)
+{
+    while (running_)
     {
-        std::lock_guard<std::mutex> lock(clientsMutex_);
-        auto it = clientThreads_.find(clientSocket);
-        if (it != clientThreads_.end())
+        int clientSocket = accept4(serverSocket_, nullptr, nullptr, SOCK_NONBLOCK);
+        if (clientSocket < 0)
         {
-            it->second.detach(); // Detach the thread
-            clientThreads_.erase(it);
+            if (errno != EAGAIN && errno != EWOULDBLOCK && running_)
+            {
+                std::cerr << "Error accepting connection\n";
+            }
+            return;
         }
 
+        auto conn = registerClient(clientSocket);
+        owned[clientSocket] = conn;
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = clientSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &ev) < 0)
         {
-            std::lock_guard<std::mutex> perfLock(perfMutex_);
-            clientPerformance_.erase(clientSocket);
+            std::cerr << "Error registering client socket\n";
+            owned.erase(clientSocket);
+            closeConnection(epollFd, conn);
         }
-
-        std::cout << "Connected clients: " << clientThreads_.size() << std::endl;
     }
 }
 
-void Master::updateClientPerformance(int clientSocket, double taskTimeMs)
+std::shared_ptr<Connection> Master::registerClient(int clientSocket)
 {
-    std::lock_guard<std::mutex> lock(perfMutex_);
+    std::string clientIp = Endpoint::peerName(clientSocket);
+    std::cout << "New client connected: " << clientIp << std::endl;
 
-    ClientInfo &info = clientPerformance_[clientSocket];
-    info.lastTaskTime = taskTimeMs;
+    // Keepalive probes notice a peer that vanished without closing (power
+    // loss, cable pull) in about ten seconds, so its leases are released
+    if (endpoint_.kind == Endpoint::ENDPOINT_TCP)
+    {
+        int on = 1, idle = 5, interval = 2, count = 3;
+        setsockopt(clientSocket, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+    }
+
+    auto conn = std::make_shared<Connection>(clientSocket, clientIp);
 
-    // Update performance ratio based on recent task time
-    // We want higher ratio for faster clients
-    if (taskTimeMs > 0)
     {
-        // Blend old ratio with new measurement (exponential smoothing)
-        const double alpha = 0.3;              // Smoothing factor
-        double newRatio = 1000.0 / taskTimeMs; // Normalize: tasks per second
-        info.performanceRatio = (1 - alpha) * info.performanceRatio + alpha * newRatio;
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        connections_[clientSocket] = conn;
+        std::cout << "Connected clients: " << connections_.size() << std::endl;
     }
 
-    std::cout << "Client " << clientSocket << " performance ratio updated to: "
-              << info.performanceRatio << std::endl;
+    return conn;
 }
 
-void Master::processResult(const Result &result)
+void Master::handleMessage(const std::shared_ptr<Connection> &conn, MessageType msgType, std::vector<char> &payload)
 {
-    // Update result matrix with the computed tile
-    // int reultCols = resultMatrix_.cols();
-    int tileWidth = result.endCol - result.startCol;
-
-    for (int row = result.startRow; row < result.endRow; row++)
+    if (msgType == HELLO)
     {
-        for (int col = result.startCol; col < result.endCol; col++)
-        {
-            int localRow = row - result.startRow;
-            int localCol = col - result.startCol;
-            int tileIdx = localRow * tileWidth + localCol;
+        welcomeClient(conn, payload);
+    }
+    else if (msgType == TASK_REQUEST)
+    {
+        // Client is asking for work; the payload carries how many more
+        // tasks it can take on top of the ones it already holds
+        replyWithTasks(conn, NetworkMessage::deserializeCredits(payload));
+    }
+    else if (msgType == COMPUTATION_RESULT)
+    {
+        // Received computation result
+        Result result = NetworkMessage::deserializeResult(payload);
+
+        // Release the client's task and update its performance metrics
+        updateClientPerformance(conn, result);
+
+        processResult(result, conn->fd());
+
+        // The result doubles as a request for the next task(s), answered
+        // in the same exchange instead of a separate TASK_REQUEST round trip
+        if (result.requestCredits > 0)
+            replyWithTasks(conn, result.requestCredits);
+    }
+    else if (msgType == SUMMA_RESULT)
+    {
+        processSummaResult(payload, conn->fd());
+    }
+    else if (msgType == PANEL_REQUEST)
+    {
+        sendPanels(conn, payload);
+    }
+    else if (msgType == OPERAND_REQUEST && payload.size() >= sizeof(size_t))
+    {
+        // A relay child lost its parent; send it the rest ourselves. At
+        // most one running job is broadcast.
+        size_t offset;
+        std::memcpy(&offset, payload.data(), sizeof(size_t));
+        std::shared_ptr<Job> broadcast;
+        {
+            std::lock_guard<std::mutex> lock(perfMutex_);
+            for (auto &[id, job] : jobs_)
+            {
+                if (job->broadcast && !job->finished)
+                    broadcast = job;
+            }
+        }
+        if (broadcast)
+            streamOperands(*broadcast, conn, offset);
+    }
+    else if (msgType == SHM_REQUEST)
+    {
+        offerSharedMemory(conn, payload);
+    }
+    else if (msgType == SHM_ATTACHED)
+    {
+        attachSharedMemory(conn);
+    }
+    else if (msgType == SHM_DECLINE)
+    {
+        // It stays on the socket, and gets what was held back for it
+        dropSharedMemory(conn);
+        conn->releaseOutput();
+    }
+    else if (msgType == CLIENT_DISCONNECT)
+    {
+        // Client is disconnecting
+        std::cout << "Client disconnected: " << conn->peer() << std::endl;
+        conn->closeAfterFlush();
+    }
+}
+
+void Master::closeConnection(int epollFd, const std::shared_ptr<Connection> &conn)
+{
+    int clientSocket = conn->fd();
+
+    // Its tiles go back in the queue for the others
+    releaseLeases(clientSocket);
+
+    // Forget the client everywhere before its descriptor can be reused
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        auto it = connections_.find(clientSocket);
+        if (it != connections_.end() && it->second == conn)
+            connections_.erase(it);
+
+        {
+            std::lock_guard<std::mutex> perfLock(perfMutex_);
+            auto info = clientPerformance_.find(clientSocket);
+            if (info != clientPerformance_.end())
+            {
+                std::lock_guard<std::mutex> clientLock(info->second->mutex);
+                unindexLoad(clientSocket, *info->second);
+                for (auto &[jobId, job] : jobs_)
+                    leaveWalk(*job, *info->second);
+                clientPerformance_.erase(info);
+            }
+        }
+
+        std::cout << "Connected clients: " << connections_.size() << std::endl;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(taskMutex_);
+        parkedRequests_.erase(std::remove_if(parkedRequests_.begin(), parkedRequests_.end(),
+                                             [&conn](const std::pair<std::shared_ptr<Connection>, int> &parked)
+                                             { return parked.first == conn; }),
+                              parkedRequests_.end());
+    }
+
+    dropSharedMemory(conn);
+
+    if (epollFd >= 0)
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
+    conn->markClosed();
+}
+
+std::string Master::shmName(const std::string &suffix) const
+{
+    return "/distmm-" + std::to_string(getpid()) + "-" + std::to_string(reinterpret_cast<uintptr_t>(this)) + "-" +
+           suffix;
+}
+
+void Master::offerSharedMemory(const std::shared_ptr<Connection> &conn, const std::vector<char> &identity)
+{
+    // The newest running job's segment, if one was made yet; the client
+    // maps the others as their tasks come up
+    std::string jobName;
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        for (auto &[id, job] : jobs_)
+        {
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            if (!job->finished && job->shm)
+                jobName = job->shm->name();
+        }
+    }
+
+    // Only a client that booted the same kernel can see our segments
+    std::string clientHost(identity.begin(), identity.end());
+    if (clientHost.empty() || clientHost != shmHostIdentity())
+    {
+        conn->queueMessage(SHM_DECLINE, {});
+        return;
+    }
+
+    std::string channelName = shmName("c" + std::to_string(nextChannel_++));
+
+    auto channel = std::make_shared<ShmChannel>();
+    if (!channel->segment.create(channelName, shmChannelSize()))
+    {
+        conn->queueMessage(SHM_DECLINE, {});
+        return;
+    }
+    shmInitChannel(channel->segment.data());
+    channel->conn = conn;
+    channel->toClient = shmRing(channel->segment.data(), true);
+    channel->toMaster = shmRing(channel->segment.data(), false);
+    channel->attached = false;
+
+    {
+        std::lock_guard<std::mutex> lock(shmMutex_);
+        shmChannels_[conn->fd()] = channel;
+    }
+
+    // Both segment names, NUL-terminated; the job's is empty while none runs
+    std::vector<char> offer;
+    offer.insert(offer.end(), jobName.begin(), jobName.end());
+    offer.push_back('\0');
+    offer.insert(offer.end(), channelName.begin(), channelName.end());
+    offer.push_back('\0');
+
+    // Once the client attaches it only reads the ring, so whatever comes
+    // up meanwhile (a JOB_START, say) waits to see which way it goes
+    conn->queueAndHold(SHM_OFFER, offer);
+}
+
+void Master::attachSharedMemory(const std::shared_ptr<Connection> &conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(shmMutex_);
+        auto it = shmChannels_.find(conn->fd());
+        if (it == shmChannels_.end() || it->second->conn != conn)
+            return;
+
+        // The client has it mapped; nobody else needs the name
+        it->second->segment.unlink();
+        it->second->attached = true;
+        shmGeneration_++;
+    }
+
+    // It reads A and B from the job segments; leave it out of the broadcast
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        clientEntry(conn->fd())->sharedMemory = true;
+    }
+
+    // From now on replies go through the ring, written by the poller,
+    // starting with those held back since the offer
+    conn->setWriteNotifier([this]()
+                           { wakeShmLoop(); });
+    conn->releaseOutput();
+    wakeShmLoop();
+
+    std::cout << "Client " << conn->peer() << " attached via shared memory\n";
+}
+
+void Master::dropSharedMemory(const std::shared_ptr<Connection> &conn)
+{
+    std::lock_guard<std::mutex> lock(shmMutex_);
+    auto it = shmChannels_.find(conn->fd());
+    if (it != shmChannels_.end() && it->second->conn == conn)
+    {
+        shmChannels_.erase(it);
+        shmGeneration_++;
+        shmWake_.notify_one();
+    }
+}
+
+void Master::wakeShmLoop()
+{
+    // Only pay for the lock when the poller is actually asleep
+    if (shmSleeping_)
+    {
+        std::lock_guard<std::mutex> lock(shmMutex_);
+        shmWake_.notify_one();
+    }
+}
+
+void Master::shmLoop()
+{
+    std::vector<std::shared_ptr<ShmChannel>> active;
+    int generation = -1;
+    ShmBackoff backoff;
+
+    while (running_)
+    {
+        // Refresh the attached channels only when the set changed
+        if (generation != shmGeneration_)
+        {
+            std::lock_guard<std::mutex> lock(shmMutex_);
+            generation = shmGeneration_;
+            active.clear();
+            for (auto &[fd, channel] : shmChannels_)
+            {
+                if (channel->attached)
+                    active.push_back(channel);
+            }
+        }
+
+        if (active.empty())
+        {
+            std::unique_lock<std::mutex> lock(shmMutex_);
+            shmSleeping_ = true;
+            shmWake_.wait(lock, [&]()
+                          { return !running_ || shmGeneration_ != generation; });
+            shmSleeping_ = false;
+            continue;
+        }
+
+        // Busy rings are polled without any syscalls
+        bool busy = false;
+        for (auto &channel : active)
+            busy = pumpSharedMemory(*channel) || busy;
+
+        if (busy)
+        {
+            backoff.reset();
+        }
+        else if (backoff.sleeping())
+        {
+            // Local replies wake us at once; clients are polled periodically
+            std::unique_lock<std::mutex> lock(shmMutex_);
+            shmSleeping_ = true;
+            shmWake_.wait_for(lock, std::chrono::microseconds(50));
+            shmSleeping_ = false;
+        }
+        else
+        {
+            backoff.pause();
+        }
+    }
+
+    // Push out anything still queued, e.g. SHUTDOWN from stop()
+    for (auto &channel : active)
+        pumpSharedMemory(*channel);
+}
+
+bool Master::pumpSharedMemory(ShmChannel &channel)
+{
+    const std::shared_ptr<Connection> &conn = channel.conn;
+    if (conn->closed())
+        return false;
+
+    bool busy = false;
+    const char *data;
+    size_t len;
+
+    // Client to master: decode straight out of shared memory
+    while ((len = channel.toMaster->readable(data)) > 0)
+    {
+        channel.reader.feed(data, len, [this, &conn](MessageType type, std::vector<char> &payload)
+                            { handleMessage(conn, type, payload); });
+        channel.toMaster->consume(len);
+        busy = true;
+    }
+
+    // Master to client: move queued replies into the ring
+    while (conn->nextOutput(data, len))
+    {
+        size_t written = channel.toClient->write(data, len);
+        if (written == 0)
+            break;  // Ring full; the client is behind
+        conn->consumeOutput(written);
+        busy = true;
+    }
+
+    return busy;
+}
+
+void Master::replyWithTasks(const std::shared_ptr<Connection> &conn, int credits)
+{
+    auto jobsRunning = [this](bool &queued)
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        bool running = false;
+        queued = false;
+        for (auto &[id, job] : jobs_)
+        {
+            if (job->finished)
+                continue;
+            running = true;
+            queued = queued || job->hasWork();
+        }
+        return running;
+    };
+
+    auto holdsTasks = [this](int clientSocket)
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        auto info = clientPerformance_.find(clientSocket);
+        return info != clientPerformance_.end() && info->second->tasksHeld > 0;
+    };
+
+    // Tasks come straight off the jobs' lock-free queues; once none has
+    // any left, idle clients may back up late tiles
+    bool requeued = false;
+    std::vector<Task> tasks = assignTasks(conn->fd(), credits, &requeued);
+    bool queued = false;
+    bool running = !tasks.empty() || jobsRunning(queued);
+    if (tasks.empty() && running && !queued)
+        tasks = assignBackups(conn->fd(), credits);
+
+    if (tasks.empty() && !holdsTasks(conn->fd()))
+    {
+        bool parked = false;
+        {
+            std::lock_guard<std::mutex> lock(taskMutex_);
+
+            // Whoever queues work next wakes the parked requests under this
+            // lock, so a retry here cannot miss it
+            tasks = assignTasks(conn->fd(), credits, &requeued);
+            if (tasks.empty() && jobsRunning(queued) && !queued)
+                tasks = assignBackups(conn->fd(), credits);
+            if (tasks.empty())
+            {
+                parkedRequests_.emplace_back(conn, credits);
+                requestsParked_ = true;
+                parked = true;
+            }
+        }
+
+        // The first try above may have put back a task (the balancer
+        // turning this client down) before a request parked
+        if (parked)
+        {
+            if (requeued)
+                wakeParked();
+            return;
+        }
+    }
+
+    // Clients that joined after a broadcast are fed directly
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+        if (i > 0 && tasks[i].jobId == tasks[i - 1].jobId)
+            continue;
+        std::shared_ptr<Job> job = findJob(tasks[i].jobId);
+        if (job)
+            ensureOperands(*job, conn);
+    }
+
+    if (!tasks.empty())
+    {
+        // Send all granted tasks in a single message
+        std::vector<char> batchData = NetworkMessage::serializeTaskBatch(tasks);
+        conn->queueMessage(TASK_BATCH, batchData);
+
+        std::cout << "Assigned tasks " << tasks.front().taskId << ".." << tasks.back().taskId
+                  << " (" << tasks.size() << ") to client "
+                  << conn->peer() << " (socket " << conn->fd() << ")" << std::endl;
+    }
+    else
+    {
+        // Nothing more until the client has drained what it holds
+        conn->queueMessage(NO_WORK, {});
+    }
+
+    // Tasks put back outside taskMutex_ (a split, the lookahead's, one the
+    // balancer turned down) may be left for idle clients; whether or not
+    // this one got any, a request that parked meanwhile must hear of them
+    if (requeued)
+        wakeParked();
+}
+
+void Master::wakeParked()
+{
+    if (!requestsParked_)
+        return;
+
+    std::vector<std::pair<std::shared_ptr<Connection>, int>> parked;
+    {
+        std::lock_guard<std::mutex> lock(taskMutex_);
+        parked.swap(parkedRequests_);
+        requestsParked_ = false;
+    }
+
+    for (auto &[conn, credits] : parked)
+    {
+        if (!conn->closed())
+            replyWithTasks(conn, credits);
+    }
+}
+
+void Master::broadcastOperands(Job &job)
+{
+    // Clients that still need operands; relay-capable ones form the tree
+    std::vector<std::pair<std::shared_ptr<Connection>, int>> relays; // <connection, relay port>
+    std::vector<std::shared_ptr<Connection>> direct;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        for (auto &[fd, conn] : connections_)
+        {
+            ClientInfo &info = *clientEntry(fd);
+            std::lock_guard<std::mutex> clientLock(info.mutex);
+            if (holdsOperands(job, fd, info))
+                continue;
+            info.broadcastJobs.insert(job.id);
+            if (info.relayPort > 0)
+                relays.emplace_back(conn, info.relayPort);
+            else
+                direct.push_back(conn);
+        }
+    }
+
+    // Heap layout under the master: relay i's parent is the master for
+    // i < FANOUT, else relay i / FANOUT - 1; its children are the next
+    // FANOUT entries after FANOUT * i
+    int count = relays.size();
+    for (int i = 0; i < count; i++)
+    {
+        BroadcastPlan plan;
+        plan.jobId = job.id;
+        plan.rowsA = job.a.rows();
+        plan.colsA = job.a.cols();
+        plan.rowsB = job.b.rows();
+        plan.colsB = job.b.cols();
+        plan.parentPort = 0;
+        if (i >= BROADCAST_FANOUT)
+        {
+            const auto &parent = relays[i / BROADCAST_FANOUT - 1];
+            plan.parentHost = parent.first->peer();
+            plan.parentPort = parent.second;
+        }
+        int firstChild = BROADCAST_FANOUT * (i + 1);
+        plan.children = std::max(0, std::min(BROADCAST_FANOUT, count - firstChild));
+
+        relays[i].first->queueMessage(BROADCAST_PLAN, NetworkMessage::serializeBroadcastPlan(plan));
+    }
+    for (int i = 0; i < std::min(count, BROADCAST_FANOUT); i++)
+        streamOperands(job, relays[i].first, 0);
+
+    for (auto &conn : direct)
+    {
+        BroadcastPlan plan = {job.id, job.a.rows(), job.a.cols(), job.b.rows(), job.b.cols(), "", 0, 0};
+        conn->queueMessage(BROADCAST_PLAN, NetworkMessage::serializeBroadcastPlan(plan));
+        streamOperands(job, conn, 0);
+    }
+
+    if (count + direct.size() > 0)
+    {
+        std::cout << "Broadcasting operands to " << count << " relaying client(s) (fan-out "
+                  << BROADCAST_FANOUT << ") and " << direct.size() << " direct; master sends "
+                  << std::min(count, BROADCAST_FANOUT) + direct.size() << " copies\n";
+    }
+}
+
+void Master::ensureOperands(Job &job, const std::shared_ptr<Connection> &conn)
+{
+    std::shared_ptr<ClientInfo> info;
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        info = clientEntry(conn->fd());
+    }
+
+    // Local clients map the job's segment, which must exist before their
+    // first task of it arrives
+    if (info->sharedMemory)
+    {
+        std::lock_guard<std::mutex> jobLock(job.mutex);
+        if (job.finished || shareOperands(job))
+            return;
+    }
+
+    if (!job.broadcast)
+        return;
+    {
+        std::lock_guard<std::mutex> clientLock(info->mutex);
+        if (job.finished || holdsOperands(job, conn->fd(), *info))
+            return;
+        info->broadcastJobs.insert(job.id);
+    }
+
+    BroadcastPlan plan = {job.id, job.a.rows(), job.a.cols(), job.b.rows(), job.b.cols(), "", 0, 0};
+    conn->queueMessage(BROADCAST_PLAN, NetworkMessage::serializeBroadcastPlan(plan));
+    streamOperands(job, conn, 0);
+}
+
+bool Master::shareOperands(Job &job)
+{
+    if (job.shm || job.shmFailed)
+        return (bool)job.shm;
+
+    job.shm.reset(new ShmJob);
+    if (!job.shm->create(job.shmName, job.a, job.b))
+    {
+        std::cerr << "Shared memory unavailable for job " << job.id << ", local clients will fetch panels\n";
+        job.shm.reset();
+        job.shmFailed = true;
+        return false;
+    }
+    return true;
+}
+
+void Master::streamOperands(const Job &job, const std::shared_ptr<Connection> &conn, size_t offset)
+{
+    // The operands as one byte stream: A's elements, then B's
+    const char *partA = reinterpret_cast<const char *>(job.a.data());
+    const char *partB = reinterpret_cast<const char *>(job.b.data());
+    size_t bytesA = (size_t)job.a.rows() * job.a.cols() * sizeof(double);
+    size_t total = bytesA + (size_t)job.b.rows() * job.b.cols() * sizeof(double);
+
+    std::vector<char> chunk;
+    while (offset < total)
+    {
+        size_t len = std::min<size_t>(BROADCAST_CHUNK_SIZE, total - offset);
+        chunk.resize(len);
+        size_t fromA = offset < bytesA ? std::min(len, bytesA - offset) : 0;
+        if (fromA > 0)
+            std::memcpy(chunk.data(), partA + offset, fromA);
+        if (fromA < len)
+            std::memcpy(chunk.data() + fromA, partB + (offset + fromA - bytesA), len - fromA);
+
+        if (!conn->queueMessage(OPERAND_CHUNK, NetworkMessage::serializeOperandChunk(offset, chunk.data(), len)))
+            return;
+        offset += len;
+    }
+}
+
+void Master::sendPanels(const std::shared_ptr<Connection> &conn, const std::vector<char> &request)
+{
+    // Panels name their operand by version; any job holding that version
+    // has the same matrix, cut the same way
+    std::vector<PanelKey> keys = NetworkMessage::deserializePanelRequest(request);
+    std::vector<std::shared_ptr<Job>> owners(keys.size());
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        for (size_t n = 0; n < keys.size(); n++)
+        {
+            for (auto &[id, job] : jobs_)
+            {
+                if (keys[n].version == (keys[n].kind == PANEL_A ? job->versionA : job->versionB))
+                    owners[n] = job;
+            }
+        }
+    }
+
+    // Every panel gets an answer: a client waiting on one we cannot send
+    // would otherwise wait forever
+    std::vector<PanelKey> gone;
+    for (size_t n = 0; n < keys.size(); n++)
+    {
+        const PanelKey &key = keys[n];
+        if (!owners[n])
+        {
+            std::cerr << "Client " << conn->peer() << " requested panel " << key.kind << "/" << key.index
+                      << " of an operand no longer held (version " << key.version << ")\n";
+            gone.push_back(key);
+            continue;
+        }
+        Job &job = *owners[n];
+
+        // Panels follow the task grid: tileSize rows of A or columns of B,
+        // the last one taking in any sliver, over one slice of the inner
+        // dimension
+        int depth = job.a.cols();
+        const Matrix &source = (key.kind == PANEL_A) ? job.a : job.bt;
+        int start = key.index * job.tileSize;
+        int end = tileEnd(start, job.tileSize, source.rows());
+        int startK = (job.kSlices > 1) ? key.slice * job.sliceDepth : 0;
+        int endK = (job.kSlices > 1) ? tileEnd(startK, job.sliceDepth, depth) : depth;
+        if (key.index < 0 || key.index >= tileCount(job.tileSize, source.rows()) ||
+            key.slice < 0 || key.slice >= job.kSlices || (key.kind != PANEL_A && key.kind != PANEL_B))
+        {
+            std::cerr << "Client " << conn->peer() << " requested invalid panel " << key.kind << "/" << key.index << "\n";
+            gone.push_back(key);
+            continue;
+        }
+
+        std::vector<char> panel =
+            NetworkMessage::serializePanel(key, start, end, endK - startK, &source.at(start, startK), depth);
+        job.panelsSent++;
+        job.panelBytesSent += panel.size();
+        if (!conn->queueMessage(PANEL_DATA, panel))
+            return;
+    }
+    if (!gone.empty())
+        conn->queueMessage(PANEL_GONE, NetworkMessage::serializePanelRequest(gone));
+}
+
+std::vector<Task> Master::assignTasks(int clientSocket, int credits, bool *requeued)
+{
+    std::vector<Task> tasks;
+
+    // perfMutex_ is only held to look up the client and the running jobs.
+    // Tasks come off the lock-free walk queues; the job's lock is taken to
+    // book one that is handed out, and the client's for its walks and panels.
+    std::shared_ptr<ClientInfo> client;
+    std::vector<std::shared_ptr<Job>> running;
+    {
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        client = clientEntry(clientSocket);
+        for (auto &[id, job] : jobs_)
+        {
+            if (!job->finished)
+                running.push_back(job);
+        }
+    }
+    ClientInfo &info = *client;
+
+    // Never let a client hold more than its advertised prefetch depth
+    credits = std::min(credits, std::max(info.prefetchDepth, 1) - info.tasksHeld);
+
+    std::vector<std::pair<double, Job *>> order; // <served, job>
+    while (credits > 0)
+    {
+        // Each task comes from the highest priority job with work left, and
+        // among equals from the one served least for its weight, so a small
+        // urgent job overtakes a long batch and equal jobs share the clients
+        order.clear();
+        for (auto &job : running)
+            order.emplace_back(job->served, job.get());
+        std::sort(order.begin(), order.end(), [](const auto &a, const auto &b)
+                  { return a.second->priority != b.second->priority ? a.second->priority > b.second->priority
+                                                                    : a.first < b.first; });
+        Job *job = nullptr;
+        Task task;
+        for (auto &[served, candidate] : order)
+        {
+            if (popTask(*candidate, info, task) || carveTask(*candidate, info, task))
+            {
+                job = candidate;
+                break;
+            }
+        }
+        if (!job)
+            break;
+
+        // A requeued tile whose original holder delivered after all
+        {
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            if (job->taskDone[task.taskId])
+                continue;
+        }
+
+        // A client whose link costs more than its compute looks a little way
+        // along its walk for the task that moves the fewest bytes (one whose
+        // panels it already holds); others take tasks in order. Candidates
+        // passed over go back to the tail.
+        bool hasOperands;
+        double transfer = 0;
+        double cost;
+        {
+            std::lock_guard<std::mutex> clientLock(info.mutex);
+            hasOperands = holdsOperands(*job, clientSocket, info);
+            cost = taskCost(info, hasOperands, task, &transfer);
+            if (transfer > cost - transfer)
+            {
+                Task candidate;
+                int walk = job->tileWalk[(size_t)task.panelA * job->gridCols + task.panelB];
+                for (int i = 1; i < TASK_LOOKAHEAD && popWalk(*job, walk, candidate); i++)
+                {
+                    double candidateTransfer = 0;
+                    double candidateCost = taskCost(info, hasOperands, candidate, &candidateTransfer);
+                    if (candidateTransfer < transfer)
+                    {
+                        std::swap(task, candidate);
+                        cost = candidateCost;
+                        transfer = candidateTransfer;
+                    }
+                    queueTask(*job, candidate);
+                    if (requeued)
+                        *requeued = true;
+                }
+            }
+        }
+
+        // A grid tile too big for this client's speed is split, unless a
+        // lease already handed it out whole; the client takes the first
+        // piece and the rest go back to the queue
+        int edge = clientTileEdge(*job, info);
+        if (task.taskId < job->gridTasks && (task.endRow - task.startRow > edge || task.endCol - task.startCol > edge))
+        {
+            std::unique_lock<std::mutex> jobLock(job->mutex);
+            if (!job->inFlight.count(task.taskId))
+            {
+                task = splitTask(*job, task, edge);
+                jobLock.unlock();
+                if (requeued)
+                    *requeued = true;
+                std::lock_guard<std::mutex> clientLock(info.mutex);
+                cost = taskCost(info, hasOperands, task, &transfer);
+            }
+        }
+
+        // Only do load balancing if we have multiple clients, and only once
+        // there are no longer enough tasks for everyone
+        long long queued = 0, cells = 0;
+        for (const auto &other : running)
+        {
+            queued += other->queuedTasks;
+            cells += other->cellsLeft;
+        }
+        bool shouldAssignTask = true;
+        int clients = indexedClients_;
+        double lightest = 0;
+        if (clients > 1 && cells == 0 && queued + 1 <= clients && lightestOther(clientSocket, lightest))
+        {
+            // Weigh the backlog by this task's estimated time here, and
+            // compare it with the least loaded other client. If this client
+            // already has more work relative to its performance, don't give
+            // it more work yet.
+            double weightedTaskCount = info.tasksHeld * cost;
+            if (weightedTaskCount > lightest)
+                shouldAssignTask = false;
+        }
+
+        if (!shouldAssignTask)
+        {
+            queueTask(*job, task);
+            if (requeued)
+                *requeued = true;
+            break;
+        }
+
+        // Book it, unless the job finished meanwhile: its tiles held are
+        // written off once, when it finishes
+        {
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            if (job->finished)
+                continue;
+            std::lock_guard<std::mutex> clientLock(info.mutex);
+            leaseTask(*job, clientSocket, info, task);
+            job->served = job->served + 2.0 * (task.endRow - task.startRow) * (task.endCol - task.startCol) *
+                                            (task.endK - task.startK) / job->weight;
+
+            // It will fetch this task's panels, so later ones sharing them are cheap
+            if (!hasOperands)
+            {
+                info.panelsHeld.insert(panelKeyId({PANEL_A, task.versionA, task.panelA, task.slice}));
+                info.panelsHeld.insert(panelKeyId({PANEL_B, task.versionB, task.panelB, task.slice}));
+            }
+        }
+        tasks.push_back(task);
+        credits--;
+    }
+
+    return tasks;
+}
+
+std::vector<Task> Master::assignBackups(int clientSocket, int credits)
+{
+    std::vector<Task> backups;
+    auto now = std::chrono::steady_clock::now();
+
+    // Tiles out for the running jobs, with whoever holds them, copied out
+    // under each job's lock in turn
+    struct Candidate
+    {
+        std::shared_ptr<Job> job;
+        Task task;
+        std::chrono::steady_clock::time_point issued;
+        int holder;
+        std::shared_ptr<ClientInfo> holderInfo; // Null once it left
+    };
+    std::vector<Candidate> candidates;
+    std::shared_ptr<ClientInfo> client;
+    {
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        client = clientEntry(clientSocket);
+        for (auto &[id, job] : jobs_)
+        {
+            if (job->finished)
+                continue;
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            if (!job->queueDrainedSeen)
+            {
+                job->queueDrainedSeen = true;
+                job->queueDrained = now;
+            }
+            for (auto &[taskId, tile] : job->inFlight)
+            {
+                if (tile.holders.size() != 1 || tile.holders.front() == clientSocket)
+                    continue;
+                auto holder = clientPerformance_.find(tile.holders.front());
+                candidates.push_back({job, tile.task, tile.issued, tile.holders.front(),
+                                      holder != clientPerformance_.end() ? holder->second : nullptr});
+            }
+        }
+    }
+
+    // Only idle clients back others up, and a tile gets one backup at most
+    ClientInfo &info = *client;
+    credits = std::min(credits, std::max(info.prefetchDepth, 1));
+    if (info.tasksHeld > 0 || credits <= 0)
+        return backups;
+
+    // Higher priority jobs' tiles come first, then the oldest
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+              { return a.job->priority != b.job->priority ? a.job->priority > b.job->priority
+                                                          : a.issued < b.issued; });
+
+    for (const Candidate &candidate : candidates)
+    {
+        if ((int)backups.size() >= credits)
+            break;
+        Job &job = *candidate.job;
+        const Task &task = candidate.task;
+
+        // When the holder should be done with it, at worst after its whole
+        // backlog; a holder that is gone or past that is a straggler
+        double elapsed = std::chrono::duration<double>(now - candidate.issued).count();
+        double remaining = 0;
+        if (candidate.holderInfo)
+        {
+            ClientInfo &holder = *candidate.holderInfo;
+            std::lock_guard<std::mutex> holderLock(holder.mutex);
+            bool holderHasOperands = holdsOperands(job, candidate.holder, holder);
+            remaining = std::max(taskCost(holder, holderHasOperands, task) * std::max(holder.tasksHeld.load(), 1) -
+                                     elapsed,
+                                 0.0);
+        }
+
+        // Otherwise only worth it if this client would finish first. Book
+        // it unless it landed, or was backed up, meanwhile.
+        std::lock_guard<std::mutex> jobLock(job.mutex);
+        auto tile = job.inFlight.find(task.taskId);
+        if (job.finished || tile == job.inFlight.end() || tile->second.holders.size() != 1)
+            continue;
+        std::lock_guard<std::mutex> clientLock(info.mutex);
+        bool hasOperands = holdsOperands(job, clientSocket, info);
+        if (remaining > 0 && taskCost(info, hasOperands, task) >= remaining)
+            continue;
+
+        backups.push_back(task);
+        leaseTask(job, clientSocket, info, task);
+        job.backupsIssued++;
+        if (!hasOperands)
+        {
+            info.panelsHeld.insert(panelKeyId({PANEL_A, task.versionA, task.panelA, task.slice}));
+            info.panelsHeld.insert(panelKeyId({PANEL_B, task.versionB, task.panelB, task.slice}));
+        }
+    }
+
+    if (!backups.empty())
+    {
+        std::cout << "Backing up " << backups.size() << " late tile(s) from task "
+                  << backups.front().taskId << " of job " << backups.front().jobId
+                  << " on client socket " << clientSocket << std::endl;
+    }
+    return backups;
+}
+
+void Master::leaseTask(Job &job, int clientSocket, ClientInfo &info, const Task &task)
+{
+    info.tasksHeld++;
+    info.jobTasksHeld[job.id]++;
+    reindexLoad(clientSocket, info);
+
+    // Long enough to work through its whole backlog, with slack for noise
+    auto now = std::chrono::steady_clock::now();
+    double cost = taskCost(info, holdsOperands(job, clientSocket, info), task);
+    double leaseSeconds = std::max(LEASE_SLACK * cost * info.tasksHeld, MIN_LEASE_MS / 1000.0);
+    auto deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double>(leaseSeconds));
+
+    // A requeued or backed-up tile keeps its earlier holders
+    auto tile = job.inFlight.find(task.taskId);
+    if (tile == job.inFlight.end())
+    {
+        job.inFlight[task.taskId] = {task, now, deadline, {clientSocket}};
+        return;
+    }
+    tile->second.holders.push_back(clientSocket);
+    tile->second.deadline = std::max(tile->second.deadline == std::chrono::steady_clock::time_point::max()
+                                         ? deadline
+                                         : tile->second.deadline,
+                                     deadline);
+}
+
+void Master::expireLeases()
+{
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<int, int>> expired; // <job, task>
+    bool running = false;
+    {
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        for (auto &[id, job] : jobs_)
+        {
+            if (job->finished)
+                continue;
+            running = true;
+
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            for (auto &[taskId, tile] : job->inFlight)
+            {
+                if (tile.deadline > now)
+                    continue;
+
+                // Its holders may still deliver; whoever is first wins
+                tile.deadline = std::chrono::steady_clock::time_point::max();
+                queueTask(*job, tile.task);
+                expired.emplace_back(id, taskId);
+            }
+        }
+    }
+
+    for (auto &[jobId, taskId] : expired)
+        std::cout << "Lease on task " << taskId << " of job " << jobId << " expired; requeued" << std::endl;
+
+    // Also gives idle clients another look for tiles late enough to back up
+    if (running)
+        wakeParked();
+}
+
+void Master::releaseLeases(int clientSocket)
+{
+    int requeued = 0;
+    {
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        for (auto &[id, job] : jobs_)
+        {
+            if (job->finished)
+                continue;
+
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            for (auto it = job->inFlight.begin(); it != job->inFlight.end();)
+            {
+                std::vector<int> &holders = it->second.holders;
+                holders.erase(std::remove(holders.begin(), holders.end(), clientSocket), holders.end());
+                if (!holders.empty())
+                {
+                    ++it;
+                    continue;
+                }
+
+                // Nobody else is on it; unless its lease already requeued it
+                if (it->second.deadline != std::chrono::steady_clock::time_point::max())
+                {
+                    queueTask(*job, it->second.task);
+                    requeued++;
+                }
+                it = job->inFlight.erase(it);
+            }
+            requeued += abandonSumma(*job, clientSocket);
+        }
+    }
+
+    if (requeued > 0)
+    {
+        std::cout << "Requeued " << requeued << " task(s) of disconnected client socket " << clientSocket << std::endl;
+        wakeParked();
+    }
+}
+
+void Master::leaseLoop()
+{
+    std::unique_lock<std::mutex> lock(leaseWakeMutex_);
+    while (running_)
+    {
+        leaseWake_.wait_for(lock, std::chrono::milliseconds(LEASE_SWEEP_MS));
+        if (!running_)
+            break;
+
+        lock.unlock();
+        expireLeases();
+        lock.lock();
+    }
+}
+
+double Master::taskCost(const ClientInfo &info, bool hasOperands, const Task &task, double *transferSeconds) const
+{
+    int rows = task.endRow - task.startRow;
+    int cols = task.endCol - task.startCol;
+    int depth = task.endK - task.startK;
+
+    double flopRate = info.performanceRatio > 0 ? info.performanceRatio.load() : 1e9;
+    double compute = 2.0 * rows * cols * depth / flopRate;
+
+    // Clients in shared memory move nothing; others return the result
+    // tile and, fetching on demand, any panel they have not been sent.
+    // Results travel the other way; the link is taken as symmetric.
+    double transfer = 0;
+    if (!(info.sharedMemory && hasOperands))
+    {
+        double bytes = (double)rows * cols * sizeof(double);
+        if (!hasOperands)
+        {
+            if (!info.panelsHeld.count(panelKeyId({PANEL_A, task.versionA, task.panelA, task.slice})))
+                bytes += (double)rows * depth * sizeof(double);
+            if (!info.panelsHeld.count(panelKeyId({PANEL_B, task.versionB, task.panelB, task.slice})))
+                bytes += (double)cols * depth * sizeof(double);
+        }
+        transfer = info.rttMs / 1000.0 + (info.sendRate > 0 ? bytes / info.sendRate : 0.0);
+    }
+
+    if (transferSeconds)
+        *transferSeconds = transfer;
+    return compute + transfer;
+}
+
+void Master::welcomeClient(const std::shared_ptr<Connection> &conn, const std::vector<char> &hello)
+{
+    Capabilities caps = NetworkMessage::deserializeCapabilities(hello);
+    if (caps.protocolVersion != PROTOCOL_VERSION || !(caps.dtypes & DTYPE_F64) || !(caps.codecs & CODEC_RAW))
+    {
+        std::cerr << "Client " << conn->peer() << " speaks protocol " << caps.protocolVersion
+                  << ", expected " << PROTOCOL_VERSION << " with f64/raw operands; closing\n";
+        conn->queueMessage(SHUTDOWN, {});
+        conn->closeAfterFlush();
+        return;
+    }
+
+    // Until its first result, rank the client by its calibration run;
+    // without one, by clock times vector width
+    static const int lanes[] = {1, 2, 4, 4, 8}; // Doubles per vector, by SimdLevel
+    int simdLevel = std::min(std::max(caps.simdLevel, 0), (int)SIMD_AVX512);
+    double flopRate = caps.gflops > 0 ? caps.gflops * 1e9 : caps.clockGHz * 1e9 * lanes[simdLevel];
+    HelloAck ack = {PROTOCOL_VERSION, grantPrefetchDepth(caps)};
+
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        ClientInfo &info = *clientEntry(conn->fd());
+        info.caps = caps;
+        info.cpuSpeed = caps.clockGHz;
+        info.performanceRatio = flopRate;
+        info.prefetchDepth = ack.prefetchDepth;
+        info.relayPort = caps.relayPort;
+        info.rttMs = conn->rttMs();
+        info.sendRate = conn->sendRate();
+        std::lock_guard<std::mutex> clientLock(info.mutex);
+        reindexLoad(conn->fd(), info);
+    }
+
+    // Then every job already running, so its tasks never arrive unannounced
+    {
+        std::lock_guard<std::mutex> lock(taskMutex_);
+        conn->queueMessage(HELLO_ACK, NetworkMessage::serializeHelloAck(ack));
+
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        for (auto &[id, job] : jobs_)
+        {
+            if (!job->finished)
+                conn->queueMessage(JOB_START, NetworkMessage::serializeJobStart(id, job->shmFailed ? "" : job->shmName));
+        }
+    }
+
+    std::cout << "Client " << conn->peer() << ": " << caps.cores << " cores, " << simdLevelName(caps.simdLevel)
+              << ", " << caps.clockGHz << " GHz, " << caps.gflops << " GFLOP/s, " << caps.memoryGBps
+              << " GB/s, L2 " << (caps.l2Bytes >> 10) << " KiB, L3 "
+              << (caps.l3Bytes >> 10) << " KiB, " << caps.numaNodes << " NUMA node(s), "
+              << (caps.memoryBytes >> 20) << " MiB free; prefetch depth " << ack.prefetchDepth
+              << " (asked " << caps.prefetchDepth << "); link RTT " << conn->rttMs() << " ms, "
+              << conn->sendRate() / 1e6 << " MB/s\n";
+}
+
+int Master::grantPrefetchDepth(const Capabilities &caps) const
+{
+    int depth = std::max(caps.prefetchDepth, 1);
+
+    // Each task held may pin an A panel, a B panel and its result tile, of
+    // the biggest running job at worst; keep them within half of the
+    // client's free memory
+    uint64_t perTask = 0;
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        for (const auto &[id, job] : jobs_)
+        {
+            if (!job->finished)
+            {
+                uint64_t edge = job->tileSize;
+                perTask = std::max<uint64_t>(perTask, (2 * edge * job->a.cols() + edge * edge) * sizeof(double));
+            }
+        }
+    }
+    if (caps.memoryBytes > 0 && perTask > 0)
+        depth = (int)std::min<uint64_t>(depth, std::max<uint64_t>(caps.memoryBytes / 2 / perTask, 1));
+
+    return depth;
+}
+
+int Master::chooseTileSize(Job &job, int &sliceDepth)
+{
+    sliceDepth = 0;
+    uint64_t l2 = 0;
+    int slots = 0;
+    int clients = 0;
+    double fastest = 0;     // flop/s
+    double total = 0;       // flop/s
+    double roundTrip = 0;   // Slowest remote link, seconds
+    double slowestLink = 0; // Slowest measured remote link, bytes/s
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        for (const auto &[fd, client] : clientPerformance_)
+        {
+            const ClientInfo &info = *client;
+            if (info.caps.protocolVersion == 0)
+                continue; // No HELLO yet
+            if (info.caps.l2Bytes > 0 && (l2 == 0 || info.caps.l2Bytes < l2))
+                l2 = info.caps.l2Bytes;
+            slots += info.prefetchDepth;
+            clients++;
+            fastest = std::max(fastest, info.performanceRatio.load());
+            total += info.performanceRatio;
+            if (!info.sharedMemory)
+            {
+                roundTrip = std::max(roundTrip, info.rttMs / 1000.0);
+                if (info.sendRate > 0 && (slowestLink == 0 || info.sendRate < slowestLink))
+                    slowestLink = info.sendRate;
+            }
+        }
+
+        // Slower clients split tiles relative to the fastest one here now,
+        // and guided chunks follow each client's share of the total
+        job.referenceRate = fastest;
+        job.totalRate = total;
+    }
+    if (clients == 0)
+        return TILE_SIZE;
+
+    int rows = job.a.rows();
+    int cols = job.b.cols();
+    int depth = std::max(job.a.cols(), 1);
+    int edge = MAX_TILE_SIZE;
+    bool splitK = job.scheduleMode == SCHEDULE_STATIC && depth > SPLIT_K_RATIO * std::max(rows, cols);
+
+    // A tile's B panel should stay within half of the smallest L2 while
+    // the rows of A stream past it; split-K keeps its slices there instead
+    if (l2 > 0 && !splitK)
+        edge = (int)std::min<uint64_t>(edge, l2 / 2 / ((uint64_t)depth * sizeof(double)));
+
+    // Enough tiles to fill every client's prefetch window twice over;
+    // guided chunks shrink on their own as the job drains
+    if (slots > 0 && job.scheduleMode == SCHEDULE_STATIC)
+        edge = std::min(edge, (int)std::sqrt((double)rows * cols / (2.0 * slots)));
+
+    // But no smaller than a tile worth sending. On the fastest client its
+    // 2e²K flops should dwarf the per-task overhead, and fetching its two
+    // panels (16eK bytes) should take no longer than computing it; both
+    // bounds outrank the cache, since a tiny tile is all overhead.
+    if (fastest > 0)
+    {
+        double overhead = roundTrip + TASK_OVERHEAD_US / 1e6;
+        double floor = std::sqrt(TASK_COMPUTE_RATIO * overhead * fastest / (2.0 * depth));
+        if (slowestLink > 0)
+            floor = std::max(floor, sizeof(double) * fastest / slowestLink);
+        edge = std::max(edge, (int)std::ceil(floor));
+    }
+
+    // Still at least two tiles per client
+    edge = std::min(edge, (int)std::sqrt((double)rows * cols / (2.0 * clients)));
+    edge = std::clamp(edge / MIN_TILE_SIZE * MIN_TILE_SIZE, MIN_TILE_SIZE, MAX_TILE_SIZE);
+
+    // An inner dimension that dwarfs the result leaves too few tiles to go
+    // round, each dragging full-length panels along: cut it into slices,
+    // enough to fill the prefetch windows twice over and to keep a slice's
+    // panel within half of the smallest L2, none too thin to be worth a task
+    if (splitK)
+    {
+        long long tiles = (long long)tileCount(edge, rows) * tileCount(edge, cols);
+        long long slices = (2LL * slots + tiles - 1) / tiles;
+        if (l2 > 0)
+            slices = std::max<long long>(slices, ((uint64_t)edge * depth * sizeof(double) + l2 / 2 - 1) / (l2 / 2));
+
+        double minDepth = MIN_SLICE_DEPTH;
+        if (fastest > 0)
+            minDepth = std::max(minDepth, TASK_COMPUTE_RATIO * (roundTrip + TASK_OVERHEAD_US / 1e6) * fastest /
+                                              (2.0 * edge * edge));
+        slices = std::min<long long>({slices, MAX_K_SLICES, (long long)(depth / minDepth)});
+
+        if (slices > 1)
+        {
+            sliceDepth = (depth + slices - 1) / slices;
+            sliceDepth = (sliceDepth + MIN_TILE_SIZE - 1) / MIN_TILE_SIZE * MIN_TILE_SIZE;
+        }
+    }
+
+    return edge;
+}
+
+int Master::clientTileEdge(const Job &job, const ClientInfo &info) const
+{
+    // Equal time per task: flops grow with the square of the edge
+    if (job.referenceRate <= 0 || info.performanceRatio <= 0 || info.performanceRatio >= job.referenceRate)
+        return job.tileSize;
+    double edge = std::max(job.tileSize * std::sqrt(info.performanceRatio / job.referenceRate), (double)MIN_TILE_SIZE);
+
+    int split = 1;
+    while (split < MAX_TILE_SPLIT && job.tileSize / (split * 2) >= edge)
+        split *= 2;
+    return job.tileSize / split;
+}
+
+bool Master::queueTask(Job &job, const Task &task)
+{
+    job.queuedTasks++;
+    if (job.walkQueues[job.tileWalk[(size_t)task.panelA * job.gridCols + task.panelB]]->tryPush(task))
+        return true;
+
+    // Walk queues hold every piece their tiles can be split into, so this
+    // is a bug, and the job would never complete
+    job.queuedTasks--;
+    std::cerr << "Walk queue of job " << job.id << " is full; task " << task.taskId << " lost\n";
+    assert(!"walk queue full");
+    return false;
+}
+
+bool Master::popWalk(Job &job, int walk, Task &task)
+{
+    if (!job.walkQueues[walk]->tryPop(task))
+        return false;
+    job.queuedTasks--;
+    return true;
+}
+
+bool Master::popTask(Job &job, ClientInfo &info, Task &task)
+{
+    std::lock_guard<std::mutex> clientLock(info.mutex);
+
+    // Keep on the current walk while it lasts
+    auto current = info.walks.find(job.id);
+    if (current != info.walks.end() && popWalk(job, current->second, task))
+        return true;
+    leaveWalk(job, info);
+    if (job.queuedTasks <= 0)
+        return false;
+
+    // Rank the walks with tasks left: the more of their panels the client
+    // holds the better, then one nobody else is on, then the fullest
+    std::vector<std::tuple<int, bool, size_t, int>> ranked;
+    for (int walk = 0; walk < (int)job.walkQueues.size(); walk++)
+    {
+        size_t left = job.walkQueues[walk]->size();
+        if (left == 0)
+            continue;
+        int held = 0;
+        if (!info.panelsHeld.empty())
+        {
+            for (int slice = 0; slice < job.kSlices; slice++)
+            {
+                for (int panel : job.walks[walk].panelsA)
+                    held += info.panelsHeld.count(panelKeyId({PANEL_A, job.versionA, panel, slice}));
+                for (int panel : job.walks[walk].panelsB)
+                    held += info.panelsHeld.count(panelKeyId({PANEL_B, job.versionB, panel, slice}));
+            }
+        }
+        ranked.emplace_back(held, job.walkers[walk] == 0, left, walk);
+    }
+    std::sort(ranked.begin(), ranked.end(), std::greater<>());
+
+    for (const auto &candidate : ranked)
+    {
+        int walk = std::get<3>(candidate);
+        if (popWalk(job, walk, task))
+        {
+            info.walks[job.id] = walk;
+            job.walkers[walk]++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Master::leaveWalk(Job &job, ClientInfo &info)
+{
+    auto current = info.walks.find(job.id);
+    if (current == info.walks.end())
+        return;
+    if (current->second < (int)job.walks.size())
+        job.walkers[current->second]--;
+    info.walks.erase(current);
+}
+
+bool Master::carveTask(Job &job, const ClientInfo &info, Task &task)
+{
+    if (job.cellsLeft <= 0)
+        return false;
+
+    std::lock_guard<std::mutex> jobLock(job.mutex);
+    if (job.cellsLeft <= 0)
+        return false;
+
+    int rows = job.a.rows();
+    int cols = job.b.cols();
+    auto [panelA, panelB] = job.tileSequence[job.carveTile];
+    int tileTop = panelA * job.tileSize;
+    int tileBottom = tileEnd(tileTop, job.tileSize, rows);
+    int startCol = panelB * job.tileSize;
+    int endCol = tileEnd(startCol, job.tileSize, cols);
+    int width = endCol - startCol;
+
+    // This client's share of what is left, spread over the chunks it may
+    // hold at once, so early chunks are whole tiles and late ones strips
+    double share = (job.totalRate > 0 && info.performanceRatio > 0)
+                       ? std::min(info.performanceRatio / job.totalRate, 1.0)
+                       : 1.0 / std::max(indexedClients_.load(), 1);
+    double cells = job.cellsLeft * share / (GUIDED_FACTOR * std::max(info.prefetchDepth, 1));
+    int minRows = std::min(MIN_TILE_SIZE, tileBottom - tileTop);
+    int height = std::max((int)std::min(cells / width, (double)job.tileSize), minRows);
+
+    // Strips run down the tile; one that would leave a sliver takes it too
+    int top = tileTop + job.carveRow;
+    int bottom = std::min(top + height, tileBottom);
+    if (tileBottom - bottom < minRows)
+        bottom = tileBottom;
+    job.carveRow = bottom - tileTop;
+    if (bottom == tileBottom)
+    {
+        job.carveTile++;
+        job.carveRow = 0;
+    }
+    job.cellsLeft -= (long long)(bottom - top) * width;
+
+    task = {};
+    task.taskId = job.nextTaskId++;
+    task.startRow = top;
+    task.endRow = bottom;
+    task.startCol = startCol;
+    task.endCol = endCol;
+    task.matrixSize = job.a.cols();
+    task.panelA = panelA;
+    task.panelB = panelB;
+    task.jobId = job.id;
+    task.versionA = job.versionA;
+    task.versionB = job.versionB;
+    task.startK = 0;
+    task.endK = task.matrixSize;
+    task.slice = 0;
+    job.taskDone.resize(task.taskId + 1, 0);
+
+    // The last chunk takes the place held for the uncarved work
+    if (job.cellsLeft > 0)
+        job.totalTasks++;
+    return true;
+}
+
+Task Master::splitTask(Job &job, const Task &task, int edge)
+{
+    int rows = task.endRow - task.startRow;
+    int cols = task.endCol - task.startCol;
+    int rowPieces = std::clamp((rows + edge / 2) / edge, 1, MAX_TILE_SPLIT);
+    int colPieces = std::clamp((cols + edge / 2) / edge, 1, MAX_TILE_SPLIT);
+
+    // The pieces replace the tile: count them before any is queued, so the
+    // job cannot look complete while they are handed out, and retire the
+    // tile's own id. Pieces get fresh ids and are never split again.
+    job.totalTasks += rowPieces * colPieces - 1;
+    job.taskDone[task.taskId] = 1;
+
+    Task first = task;
+    for (int i = 0; i < rowPieces; i++)
+    {
+        for (int j = 0; j < colPieces; j++)
+        {
+            Task piece = task;
+            piece.taskId = job.nextTaskId++;
+            piece.startRow = task.startRow + rows * i / rowPieces;
+            piece.endRow = task.startRow + rows * (i + 1) / rowPieces;
+            piece.startCol = task.startCol + cols * j / colPieces;
+            piece.endCol = task.startCol + cols * (j + 1) / colPieces;
+            job.taskDone.resize(piece.taskId + 1, 0);
+            if (i == 0 && j == 0)
+                first = piece;
+            else
+                queueTask(job, piece);
+        }
+    }
+    return first;
+}
+
+void Master::updateClientPerformance(const std::shared_ptr<Connection> &conn, const Result &result)
+{
+    int clientSocket = conn->fd();
+    double rttMs = conn->rttMs();
+    double sendRate = conn->sendRate();
+
+    std::shared_ptr<ClientInfo> client;
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(perfMutex_);
+        client = clientEntry(clientSocket);
+        auto found = jobs_.find(result.jobId);
+        if (found != jobs_.end())
+            job = found->second;
+    }
+    ClientInfo &info = *client;
+
+    // Tiles of a finished job were written off when it finished, under
+    // the job's lock
+    std::unique_lock<std::mutex> jobLock;
+    if (job)
+        jobLock = std::unique_lock<std::mutex>(job->mutex);
+    std::unique_lock<std::mutex> clientLock(info.mutex);
+    auto held = info.jobTasksHeld.find(result.jobId);
+    if (job && !job->finished && held != info.jobTasksHeld.end())
+    {
+        info.tasksHeld--;
+        if (--held->second == 0)
+            info.jobTasksHeld.erase(held);
+    }
+    info.lastTaskTime = result.executionTimeMs;
+    info.rttMs = rttMs;
+    info.sendRate = sendRate;
+
+    // Update performance ratio based on recent task time, in the same
+    // flop/s as the calibration so tiles of any shape compare
+    if (result.executionTimeMs > 0)
+    {
+        // Blend old ratio with new measurement (exponential smoothing)
+        const double alpha = 0.3; // Smoothing factor
+        double flops = 2.0 * (result.endRow - result.startRow) * (result.endCol - result.startCol) *
+                       (double)(result.endK - result.startK);
+        double newRatio = flops / (result.executionTimeMs / 1000.0);
+        info.performanceRatio = (1 - alpha) * info.performanceRatio + alpha * newRatio;
+    }
+    reindexLoad(clientSocket, info);
+    clientLock.unlock();
+    if (jobLock.owns_lock())
+        jobLock.unlock();
+
+    std::cout << "Client " << clientSocket << " performance ratio updated to: "
+              << info.performanceRatio / 1e9 << " GFLOP/s" << std::endl;
+}
+
+void Master::reindexLoad(int clientSocket, ClientInfo &info)
+{
+    // Cost of a typical tile of the latest job at the client's edge,
+    // fetching both of its panels unless the client holds the operands
+    std::shared_ptr<Job> latest = std::atomic_load(&lastJob_);
+    Task typical = {};
+    typical.endRow = latest ? clientTileEdge(*latest, info) : TILE_SIZE;
+    typical.endCol = typical.endRow;
+    typical.panelA = typical.panelB = -1;
+    bool hasOperands = latest ? holdsOperands(*latest, clientSocket, info) : info.sharedMemory.load();
+
+    double load = std::max(info.tasksHeld.load(), 0) * taskCost(info, hasOperands, typical);
+
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    loadOrder_.erase({info.load, clientSocket});
+    info.load = load;
+    loadOrder_.insert({info.load, clientSocket});
+    publishLightest();
+}
+
+void Master::unindexLoad(int clientSocket, ClientInfo &info)
+{
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    loadOrder_.erase({info.load, clientSocket});
+    publishLightest();
+}
+
+void Master::publishLightest()
+{
+    auto entry = loadOrder_.begin();
+    for (int slot = 0; slot < 2; slot++)
+    {
+        lightest_[slot] = entry != loadOrder_.end() ? packLoad(entry->first, entry->second) : packLoad(0, -1);
+        if (entry != loadOrder_.end())
+            ++entry;
+    }
+    indexedClients_ = (int)loadOrder_.size();
+}
+
+bool Master::lightestOther(int clientSocket, double &load) const
+{
+    for (int slot = 0; slot < 2; slot++)
+    {
+        int lightest = unpackLoad(lightest_[slot], load);
+        if (lightest >= 0 && lightest != clientSocket)
+            return true;
+    }
+    return false;
+}
+
+bool Master::holdsOperands(const Job &job, int clientSocket, const ClientInfo &info) const
+{
+    return (info.sharedMemory && !job.shmFailed) || info.broadcastJobs.count(job.id);
+}
+
+std::shared_ptr<Master::ClientInfo> &Master::clientEntry(int clientSocket)
+{
+    std::shared_ptr<ClientInfo> &info = clientPerformance_[clientSocket];
+    if (!info)
+        info = std::make_shared<ClientInfo>();
+    return info;
+}
+
+void Master::processResult(const Result &result, int clientSocket)
+{
+    // A result from a finished job has no place in any matrix
+    std::shared_ptr<Job> found = findJob(result.jobId);
+    if (!found || found->finished)
+    {
+        std::cerr << "Dropping result of task " << result.taskId << " from finished job " << result.jobId << "\n";
+        return;
+    }
+    Job &job = *found;
+
+    // The first copy of a tile to arrive wins; its twin is ignored
+    {
+        std::lock_guard<std::mutex> jobLock(job.mutex);
+        if (result.taskId < 0 || result.taskId >= (int)job.taskDone.size() || job.taskDone[result.taskId])
+        {
+            std::cout << "Ignoring duplicate result of task " << result.taskId << std::endl;
+            return;
+        }
+        job.taskDone[result.taskId] = 1;
+
+        auto tile = job.inFlight.find(result.taskId);
+        if (tile != job.inFlight.end())
+        {
+            if (tile->second.holders.front() != clientSocket)
+                job.backupsWon++;
+            job.inFlight.erase(tile);
+        }
+    }
+
+    // Update result matrix with the computed tile
+    // int reultCols = resultMatrix_.cols();
+    int tileWidth = result.endCol - result.startCol;
+
+    // Local clients wrote the tile into shared memory
+    if (result.inPlace && job.shm)
+    {
+        MatrixView shared = job.shm->result();
+        for (int row = result.startRow; row < result.endRow; row++)
+        {
+            std::memcpy(&job.result.at(row, result.startCol), &shared.at(row, result.startCol),
+                        tileWidth * sizeof(double));
+        }
+    }
+    else if (result.endK - result.startK < job.a.cols())
+    {
+        // A partial sum over one inner slice; the tile's other slices may
+        // be landing from other threads at the same time
+        std::lock_guard<std::mutex> lock(job.reduceMutex);
+        for (int row = result.startRow; row < result.endRow; row++)
+        {
+            addRow(&job.result.at(row, result.startCol),
+                   &result.resultTile[(size_t)(row - result.startRow) * tileWidth], tileWidth);
+        }
+    }
+    else
+    {
+        for (int row = result.startRow; row < result.endRow; row++)
+        {
+            for (int col = result.startCol; col < result.endCol; col++)
+            {
+                int localRow = row - result.startRow;
+                int localCol = col - result.startCol;
+                int tileIdx = localRow * tileWidth + localCol;
+
+                job.result.at(row, col) = result.resultTile[tileIdx];
+            }
+        }
+    }
+
+    std::cout << "Completed task " << result.taskId << " of job " << job.id
+              << " (" << job.completedTasks + 1 << "/" << job.totalTasks << ")" << std::endl;
+    completeTasks(job, 1);
+}
+
+void Master::completeTasks(Job &job, int count)
+{
+    // Exactly one thread sees the last tile land
+    int completed = job.completedTasks += count;
+    if (completed == job.totalTasks)
+    {
+        std::cout << "Matrix multiplication of job " << job.id << " complete!" << std::endl;
+        {
+            std::lock_guard<std::mutex> jobLock(job.mutex);
+            if (job.queueDrainedSeen)
+            {
+                double tailMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.queueDrained).count();
+                std::cout << "Tail after the queue drained: " << tailMs << " ms; " << job.backupsIssued
+                          << " backup tile(s) issued, " << job.backupsWon << " won" << std::endl;
+            }
+        }
+        if (job.panelsSent > 0)
+        {
+            std::cout << "Served " << job.panelsSent << " operand panels ("
+                      << job.panelBytesSent / (1024.0 * 1024.0) << " MiB) on demand" << std::endl;
+        }
+        finishJob(job);
+    }
+}
+
+void Master::finishJob(Job &job)
+{
+    // Tiles of it still out are dropped by the clients holding them
+    {
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        std::lock_guard<std::mutex> jobLock(job.mutex);
+        job.finished = true;
+        job.inFlight.clear();
+
+        // Clients let go of the segment on JOB_DONE; its results are in
+        job.shm.reset();
+        for (auto &[fd, info] : clientPerformance_)
+        {
+            std::lock_guard<std::mutex> clientLock(info->mutex);
+            auto held = info->jobTasksHeld.find(job.id);
+            if (held != info->jobTasksHeld.end())
+            {
+                info->tasksHeld -= held->second;
+                info->jobTasksHeld.erase(held);
+            }
+            leaveWalk(job, *info);
+            reindexLoad(fd, *info);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(jobDoneMutex_);
+        jobDone_.notify_all();
+    }
+
+    std::vector<char> payload(sizeof(int));
+    std::memcpy(payload.data(), &job.id, sizeof(int));
+
+    std::lock_guard<std::mutex> lock(clientsMutex_);
+    for (auto &client : connections_)
+    {
+        client.second->queueMessage(JOB_DONE, payload);
+    }
+}
+
+void Master::startSumma(Job &job)
+{
+    // Members need a peer listener and their own copy of the operands;
+    // clients on shared memory keep to tiles, and each client's SUMMA node
+    // serves one job at a time. Fastest first, so those are the ones kept
+    // when the grid cannot use everyone.
+    std::vector<std::tuple<double, int, std::shared_ptr<Connection>, int>> candidates; // <-rate, socket, connection, port>
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        bool busy = std::any_of(jobs_.begin(), jobs_.end(), [&job](const auto &entry)
+                                { return entry.second.get() != &job && !entry.second->finished &&
+                                         !entry.second->summaMembers.empty(); });
+        for (auto &[fd, conn] : connections_)
+        {
+            auto info = clientPerformance_.find(fd);
+            if (!busy && info != clientPerformance_.end() && info->second->caps.summaPort > 0 && !info->second->sharedMemory)
+                candidates.emplace_back(-info->second->performanceRatio, fd, conn, info->second->caps.summaPort);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    // The squarest grid of as many members as fit the tile grid: no grid
+    // row or column may be left without blocks
+    int rowTiles = tileCount(job.tileSize, job.a.rows());
+    int colTiles = tileCount(job.tileSize, job.b.cols());
+    int gridRows = 0, gridCols = 0;
+    for (int members = std::min<int>(candidates.size(), rowTiles * colTiles); members >= 2 && !gridRows; members--)
+    {
+        for (int p = (int)std::sqrt((double)members); p >= 1; p--)
+        {
+            if (members % p == 0 && p <= rowTiles && members / p <= colTiles)
+            {
+                gridRows = p;
+                gridCols = members / p;
+                break;
+            }
+        }
+    }
+
+    if (!gridRows)
+    {
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        for (const Task &task : job.summaTiles)
+            queueTask(job, task);
+        std::cout << "Fewer than two free clients can join a SUMMA grid; job " << job.id
+                  << " runs as " << job.summaTiles.size() << " tiles" << std::endl;
+        return;
+    }
 
-            resultMatrix_.at(row, col) = result.resultTile[tileIdx];
+    int members = gridRows * gridCols;
+    std::vector<std::pair<std::string, int>> peers;
+    for (int rank = 0; rank < members; rank++)
+        peers.emplace_back(std::get<2>(candidates[rank])->peer(), std::get<3>(candidates[rank]));
+
+    {
+        std::lock_guard<std::mutex> perfLock(perfMutex_);
+        std::lock_guard<std::mutex> jobLock(job.mutex);
+        job.summaGridRows = gridRows;
+        job.summaGridCols = gridCols;
+        for (int rank = 0; rank < members; rank++)
+            job.summaMembers[std::get<1>(candidates[rank])] = {rank / gridCols, rank % gridCols, false};
+    }
+
+    // The master sends every element of A and B exactly once
+    for (int rank = 0; rank < members; rank++)
+    {
+        const std::shared_ptr<Connection> &conn = std::get<2>(candidates[rank]);
+        int row = rank / gridCols, col = rank % gridCols;
+        SummaPlan plan = {job.id, gridRows, gridCols, row, col, job.tileSize,
+                          job.a.rows(), job.b.cols(), job.a.cols(), peers};
+        conn->queueMessage(SUMMA_PLAN, NetworkMessage::serializeSummaPlan(plan));
+
+        SummaData a = packCyclic(job.a, job.tileSize, gridRows, row, gridCols, col);
+        a.jobId = job.id;
+        a.piece = SUMMA_A;
+        conn->queueMessage(SUMMA_OPERANDS, NetworkMessage::serializeSummaData(a));
+
+        SummaData b = packCyclic(job.b, job.tileSize, gridRows, row, gridCols, col);
+        b.jobId = job.id;
+        b.piece = SUMMA_B;
+        conn->queueMessage(SUMMA_OPERANDS, NetworkMessage::serializeSummaData(b));
+    }
+
+    std::cout << "SUMMA grid of " << gridRows << "x" << gridCols << " clients for job " << job.id << " ("
+              << candidates.size() - members << " left out), " << job.tileSize << "x" << job.tileSize << " blocks"
+              << std::endl;
+}
+
+void Master::processSummaResult(const std::vector<char> &payload, int clientSocket)
+{
+    SummaData result = NetworkMessage::deserializeSummaData(payload);
+    std::shared_ptr<Job> found = findJob(result.jobId);
+    if (!found || found->finished)
+    {
+        std::cerr << "Dropping SUMMA result of finished job " << result.jobId << "\n";
+        return;
+    }
+    Job &job = *found;
+
+    int rows = job.a.rows();
+    int cols = job.b.cols();
+    int newlyDone = 0;
+    {
+        std::unique_lock<std::mutex> jobLock(job.mutex);
+        auto member = job.summaMembers.find(clientSocket);
+        if (member == job.summaMembers.end() || member->second.done)
+            return;
+
+        int row = member->second.row, col = member->second.col;
+        if (result.step < 0 || result.rows != cyclicExtent(rows, job.tileSize, job.summaGridRows, row) ||
+            result.cols != cyclicExtent(cols, job.tileSize, job.summaGridCols, col) ||
+            result.data.size() != (size_t)result.rows * result.cols)
+        {
+            int requeued = abandonSumma(job, clientSocket);
+            jobLock.unlock();
+            std::cout << "SUMMA member (" << row << ", " << col << ") gave up; queued its " << requeued
+                      << " tile(s)" << std::endl;
+            wakeParked();
+            return;
+        }
+        member->second.done = true;
+
+        // Unpack its blocks of C; tiles a fallback task already delivered
+        // are left alone
+        int edge = job.tileSize;
+        int rowTiles = tileCount(edge, rows);
+        int colTiles = tileCount(edge, cols);
+        for (int bi = row, localRow = 0; bi < rowTiles; localRow += tileEnd(bi * edge, edge, rows) - bi * edge, bi += job.summaGridRows)
+        {
+            for (int bj = col, localCol = 0; bj < colTiles; localCol += tileEnd(bj * edge, edge, cols) - bj * edge, bj += job.summaGridCols)
+            {
+                const Task &tile = job.summaTiles[(size_t)bi * colTiles + bj];
+                if (job.taskDone[tile.taskId])
+                    continue;
+                job.taskDone[tile.taskId] = 1;
+                newlyDone++;
+
+                for (int r = tile.startRow; r < tile.endRow; r++)
+                {
+                    std::memcpy(&job.result.at(r, tile.startCol),
+                                &result.data[(size_t)(localRow + r - tile.startRow) * result.cols + localCol],
+                                (tile.endCol - tile.startCol) * sizeof(double));
+                }
+            }
         }
     }
 
-    completedTasks_++;
-    std::cout << "Completed task " << result.taskId
-              << " (" << completedTasks_ << "/" << totalTasks_ << ")" << std::endl;
+    std::cout << "SUMMA piece of " << result.rows << "x" << result.cols << " arrived after " << result.step
+              << " steps: " << newlyDone << " tile(s) (" << job.completedTasks + newlyDone << "/" << job.totalTasks
+              << ")" << std::endl;
+    completeTasks(job, newlyDone);
+}
 
-    if (isComplete())
+int Master::abandonSumma(Job &job, int clientSocket)
+{
+    auto member = job.summaMembers.find(clientSocket);
+    if (member == job.summaMembers.end() || member->second.done)
+        return 0;
+    member->second.done = true;
+
+    // Its tiles become ordinary tasks for whoever asks next
+    int rowTiles = tileCount(job.tileSize, job.a.rows());
+    int colTiles = tileCount(job.tileSize, job.b.cols());
+    int queued = 0;
+    for (int bi = member->second.row; bi < rowTiles; bi += job.summaGridRows)
     {
-        std::cout << "Matrix multiplication complete!" << std::endl;
+        for (int bj = member->second.col; bj < colTiles; bj += job.summaGridCols)
+        {
+            const Task &tile = job.summaTiles[(size_t)bi * colTiles + bj];
+            if (!job.taskDone[tile.taskId])
+            {
+                queueTask(job, tile);
+                queued++;
+            }
+        }
     }
+    return queued;
 }
 
 void Master::redistributeWork()
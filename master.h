@@ -1,89 +1,486 @@
 #pragma once
 #include "common.h"
+#include "connection.h"
+#include "endpoint.h"
+#include "mpmc_queue.h"
+#include "tile_order.h"
+#include "shm_transport.h"
+#include "transport.h"
 #include <map>
-#include <queue>
+#include <memory>
+#include <set>
+#include <unordered_set>
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 
-// Define tile size for matrix multiplication
+// Define tile size for matrix multiplication: the edge used until clients
+// have reported their caches, and the bounds of the edge chosen from them
 #define TILE_SIZE 64
+#define MIN_TILE_SIZE 16
+#define MAX_TILE_SIZE 256
+
+// Slower clients get a job tile split into up to MAX_TILE_SPLIT pieces
+// per side, so every client spends about as long on one task
+#define MAX_TILE_SPLIT 4
+
+// A tile should compute for at least TASK_COMPUTE_RATIO times its
+// overhead: the link round trip plus TASK_OVERHEAD_US of dispatch
+#define TASK_COMPUTE_RATIO 20
+#define TASK_OVERHEAD_US 100
+
+// Split-K: an inner dimension over SPLIT_K_RATIO times the larger side of
+// the result is cut into up to MAX_K_SLICES slices of at least
+// MIN_SLICE_DEPTH, each tile's slices becoming tasks of their own
+#define SPLIT_K_RATIO 4
+#define MAX_K_SLICES 16
+#define MIN_SLICE_DEPTH 256
+
+// How far down the task queue a transfer-bound client looks for a task
+// that moves fewer bytes
+#define TASK_LOOKAHEAD 8
+
+// Task leases: a tile not returned within LEASE_SLACK times its holder's
+// estimated backlog time (and at least MIN_LEASE_MS) goes back in the
+// queue. Leases are checked every LEASE_SWEEP_MS.
+#define LEASE_SLACK 4
+#define MIN_LEASE_MS 1000
+#define LEASE_SWEEP_MS 250
+
+// Guided scheduling: a chunk is the requesting client's speed share of the
+// work not yet carved, divided by GUIDED_FACTOR and its prefetch depth
+#define GUIDED_FACTOR 2
+
+// Number of event-loop threads serving client connections
+#define MASTER_IO_THREADS 2
+
+// How clients that do not share memory with the master get A and B
+enum OperandMode
+{
+    OPERANDS_ON_DEMAND,  // Clients fetch the panels their tasks name (PANEL_REQUEST)
+    OPERANDS_BROADCAST   // Whole matrices pushed down a relay tree up front
+};
+
+// How a job's result is cut into tasks
+enum ScheduleMode
+{
+    SCHEDULE_STATIC,  // Uniform tiles queued up front; slower clients split theirs
+    SCHEDULE_GUIDED,  // Chunks carved as clients ask, shrinking as work runs out
+    SCHEDULE_SUMMA    // One block-cyclic piece of C per client, panels passed between peers
+};
 
 class Master {
 public:
-    Master(int port);
+    Master(int port, int ioThreads = MASTER_IO_THREADS);
+    Master(const Endpoint& endpoint, int ioThreads = MASTER_IO_THREADS);
     ~Master();
     
     void start();
     void stop();
     
-    // Set matrices for multiplication
-    void setMatrices(const Matrix& a, const Matrix& b);
+    // Choose the event loop backend; call before start(). io_uring falls
+    // back to epoll when the kernel does not allow it.
+    void setIoBackend(IoBackend backend);
+    
+    // Choose how remote clients receive operands. Jobs take the mode in
+    // force when submitted; only a job running alone is broadcast.
+    void setOperandMode(OperandMode mode) { operandMode_ = mode; }
+    
+    // Choose how jobs are cut into tasks, and the order clients walk the
+    // tile grid in; jobs take the settings in force when submitted
+    void setScheduleMode(ScheduleMode mode) { scheduleMode_ = mode; }
+    void setTileOrder(TileOrder order) { tileOrder_ = order; }
+    
+    // Start a job computing a x b and return its id, or -1 if the shapes do
+    // not match. Jobs run side by side over the connected clients, which
+    // stay attached between them: the highest priority job with work left
+    // is served first, and jobs of equal priority share the clients in
+    // proportion to their weight.
+    int submitJob(const Matrix& a, const Matrix& b, int priority = 0, double weight = 1.0);
     
-    // Begin computation after clients have connected
-    void startComputation();
+    // Check if a job is complete
+    bool isComplete(int jobId) const;
     
-    // Check if computation is complete
-    bool isComplete() const;
+    // Block until a job completes; false for an unknown job or once the
+    // master stops
+    bool waitForJob(int jobId);
     
-    // Get the result matrix
-    Matrix getResult() const;
+    // Get a completed job's result matrix; the master forgets the job
+    Matrix takeResult(int jobId);
     
     // Get current number of connected clients
     int getClientCount() const;
 
 private:
+    // dispatch_bench drives the request handlers without sockets
+    friend struct DispatchBench;
+
     // Server socket
     int serverSocket_;
-    int port_;
+    Endpoint endpoint_;  // TCP port or unix socket we listen on
     std::atomic<bool> running_;
-    std::atomic<bool> computationStarted_;
     
-    // Input and output matrices
-    Matrix matrixA_;
-    Matrix matrixB_;
-    Matrix resultMatrix_;
+    OperandMode operandMode_;
+    ScheduleMode scheduleMode_;
+    TileOrder tileOrder_;
+    int nextJobId_;
+    
+    // Operand versions named in tasks and panels. An operand equal to the
+    // previous job's, tiled the same way, keeps its version, so client
+    // panel caches stay warm.
+    int nextVersion_;
+    
+    // Event loop: a fixed pool of I/O threads, each with its own epoll set.
+    // Every thread watches the listening socket and owns what it accepts.
+    int ioThreadCount_;
+    IoBackend ioBackend_;
+    std::vector<std::thread> ioThreads_;
+    int wakeupFd_;  // eventfd used to stop the loops
+    
+    // Shared memory for clients on this host: a job local clients work on
+    // has a segment holding its A, B and C; each attached client gets a
+    // pair of rings that one poller thread drains, while its socket only
+    // reports disconnects
+    struct ShmChannel
+    {
+        std::shared_ptr<Connection> conn;
+        ShmSegment segment;
+        ShmRing *toClient;
+        ShmRing *toMaster;
+        MessageReader reader;
+        bool attached;
+    };
+    std::map<int, std::shared_ptr<ShmChannel>> shmChannels_; // <socket, channel>
+    std::mutex shmMutex_;
+    std::condition_variable shmWake_;
+    std::atomic<bool> shmSleeping_;
+    std::atomic<int> shmGeneration_;  // Bumped whenever shmChannels_ changes
+    std::atomic<int> nextChannel_;
+    std::thread shmThread_;
+    
+    // Name of one of our segments: the process and this master in it, so
+    // two masters in a process never collide, then `suffix`
+    std::string shmName(const std::string& suffix) const;
     
     // Tracking tasks and clients
-    std::map<int, std::thread> clientThreads_;
+    std::map<int, std::shared_ptr<Connection>> connections_; // <socket, connection>
     mutable std::mutex clientsMutex_;
-    // Track how many tasks each client is currently processing
-    std::map<int, int> clientTaskCounts_; // <socket, task count>
     
-    std::queue<Task> taskQueue_;
-    std::mutex taskMutex_;
-    std::condition_variable taskCV_;
+    // A run of tiles in a job's tile order (a tile row, or a compact block)
+    // whose panels a client reuses as it works through them
+    struct Walk
+    {
+        std::vector<int> panelsA;  // Panel indices its tiles name
+        std::vector<int> panelsB;
+    };
+    
+    // SUMMA grid member: its position, and whether its piece of C is in
+    struct SummaMember
+    {
+        int row, col;
+        bool done;
+    };
+    
+    // Leases and speculative backups: tiles handed out and not yet done. A
+    // tile whose lease runs out, or whose last holder disconnects, is
+    // queued again. Once no job has queued work, idle clients get copies of
+    // the oldest ones that look late. The first result wins, the other is
+    // ignored.
+    struct InFlight
+    {
+        Task task;
+        std::chrono::steady_clock::time_point issued;
+        std::chrono::steady_clock::time_point deadline;  // Lease expiry; max() once requeued
+        std::vector<int> holders;  // Sockets computing it, the original first
+    };
+    
+    // One submitted job: its operands, its result and its tasks. Jobs are
+    // tiled when submitted, for the clients connected then. Its scheduling
+    // state that is not atomic (leases, done flags, carving and SUMMA
+    // members) is under its own mutex, so requests for different tasks do
+    // not wait on one lock; the operands never change once the job is
+    // published.
+    struct Job
+    {
+        std::mutex mutex;
+        int id = 0;
+        int priority = 0;
+        double weight = 1.0;
+        std::atomic<double> served{0};  // Flops handed out over weight; the least served goes first
+        ScheduleMode scheduleMode = SCHEDULE_STATIC;
+        TileOrder tileOrder = TILE_ORDER_ROWS;
+        std::atomic<bool> finished{false};
+        
+        // Input and output matrices
+        Matrix a{1, 1};
+        Matrix b{1, 1};
+        Matrix bt{1, 1};      // B transposed: B column panels are contiguous row blocks
+        Matrix result{1, 1};
+        // Segment for local clients, named in JOB_START. It is created when
+        // the first of them is handed a task of the job, under the job's
+        // mutex, and released when the job is done.
+        std::string shmName;
+        std::unique_ptr<ShmJob> shm;
+        std::atomic<bool> shmFailed{false};  // Local clients fetch panels instead
+        int versionA = 0;
+        int versionB = 0;
+        bool broadcast = false;       // Operands pushed down the relay tree
+        std::mutex reduceMutex;       // Partial sums of a split-K job landing in C
+        
+        int tileSize = TILE_SIZE; // Edge of the job's tiles and panels
+        int gridTasks = 0;        // Tasks of the tile grid; later ids are pieces of them
+        int sliceDepth = 0;       // Inner dimension per task, 0 for all of it
+        int kSlices = 1;          // Slices the inner dimension is cut into
+        double referenceRate = 0; // flop/s of the fastest client when the job was tiled
+        double totalRate = 0;     // Summed flop/s of the clients when the job was tiled
+        std::atomic<long long> panelsSent{0};
+        std::atomic<long long> panelBytesSent{0};
+        
+        // Pending tasks, one queue per walk; tasks are pushed and popped
+        // without a lock
+        std::vector<std::unique_ptr<MpmcQueue<Task>>> walkQueues;
+        std::vector<Walk> walks;
+        std::vector<std::pair<int, int>> tileSequence;  // Grid tiles in tileOrder
+        std::vector<int> tileWalk;  // By panelA * gridCols + panelB
+        std::unique_ptr<std::atomic<int>[]> walkers;  // By walk: clients on it
+        int gridCols = 1;
+        std::atomic<long long> queuedTasks{0};  // Across all walks
+        
+        // Guided scheduling: the tile of tileSequence being carved into row
+        // strips and how far down it the strips have reached
+        int carveTile = 0;
+        int carveRow = 0;
+        std::atomic<long long> cellsLeft{0};  // Result cells not yet carved into tasks
+        
+        // SUMMA: each grid member's position, and the tiles by row *
+        // gridCols + column. A member that fails or leaves before its piece
+        // of C arrives has its tiles queued as tasks.
+        std::map<int, SummaMember> summaMembers;  // <socket, member>
+        int summaGridRows = 0;
+        int summaGridCols = 0;
+        std::vector<Task> summaTiles;
+        
+        std::map<int, InFlight> inFlight;  // <taskId, tile>
+        std::vector<char> taskDone;        // By taskId: a result was accepted
+        std::chrono::steady_clock::time_point queueDrained;  // First request that found no task
+        bool queueDrainedSeen = false;
+        int backupsIssued = 0;
+        int backupsWon = 0;
+        
+        std::atomic<int> nextTaskId{0};
+        std::atomic<int> completedTasks{0};
+        std::atomic<int> totalTasks{0};
+        
+        bool hasWork() const { return queuedTasks > 0 || cellsLeft > 0; }
+    };
+    
+    // Jobs by id, under perfMutex_, until their result is taken. The last
+    // one submitted stays around to compare the next one's operands with;
+    // it is read and replaced with std::atomic_load/atomic_store.
+    std::map<int, std::shared_ptr<Job>> jobs_;
+    std::shared_ptr<Job> lastJob_;
+    std::shared_ptr<Job> findJob(int jobId) const;
+    
+    // Requests of idle clients that found no task, held until work turns
+    // up: a job starting, tiles queued again, or a tile late enough to back
+    // up (checked each lease sweep). The reply is the long-poll's answer.
+    std::vector<std::pair<std::shared_ptr<Connection>, int>> parkedRequests_;
+    std::atomic<bool> requestsParked_;
+    std::mutex taskMutex_;  // Job start, parked requests
+    
+    // Answer the parked requests again; those still without work park anew
+    void wakeParked();
+    
+    // Signalled whenever a job finishes, for waitForJob()
+    std::mutex jobDoneMutex_;
+    std::condition_variable jobDone_;
     
     std::map<int, Result> results_;
     std::mutex resultsMutex_;
-    
-    std::atomic<int> nextTaskId_;
-    std::atomic<int> completedTasks_;
-    std::atomic<int> totalTasks_;
 
-    // Client performance tracking
+    // Client performance tracking. The counters and measurements are
+    // atomic, so the balancer and other clients' requests read them
+    // without a lock. The walks, panels and per-job counts are under the
+    // client's own mutex; what HELLO set is written once, under perfMutex_.
     struct ClientInfo {
+        std::mutex mutex;
         double cpuSpeed;        // GHz
-        double lastTaskTime;    // ms
-        double performanceRatio; // Higher is better
+        std::atomic<int> tasksHeld{0}; // Granted tasks whose result has not arrived
+        std::map<int, int> jobTasksHeld; // <job, tasks of it among tasksHeld>
+        std::atomic<double> lastTaskTime{0}; // ms
+        std::atomic<double> performanceRatio{0}; // Sustained flop/s; higher is better
+        int prefetchDepth = 1;  // Max tasks the client may hold (granted in HELLO_ACK)
+        int relayPort = 0;      // Operand relay listener, 0 if it cannot relay
+        Capabilities caps = {}; // As reported in HELLO
+        std::atomic<bool> sharedMemory{false}; // Attached over shm: operands mapped, results written in place
+        std::atomic<double> rttMs{0};    // Link round trip, 0 if local or unmeasured
+        std::atomic<double> sendRate{0}; // Link bytes/s, 0 if local or unmeasured
+        std::unordered_set<uint64_t> panelsHeld; // panelKeyId of panels its tasks named
+        std::set<int> broadcastJobs; // Jobs whose operands were sent or planned it
+        double load = 0;        // tasksHeld x cost of a typical tile; key in loadOrder_
+        std::map<int, int> walks; // <job, walk it is working through>
     };
-    std::map<int, ClientInfo> clientPerformance_;
-    std::mutex perfMutex_;
     
-    // Calculate client performance ratio
-    void updateClientPerformance(int clientSocket, double taskTimeMs);
+    // Clients by socket, and the running jobs, under perfMutex_. Requests
+    // take it only to look their client and the jobs up; locks go
+    // perfMutex_, then a job's, then a client's, then loadMutex_.
+    std::map<int, std::shared_ptr<ClientInfo>> clientPerformance_;
+    mutable std::mutex perfMutex_;
+    
+    // A client's record, created on first use. Caller must hold perfMutex_.
+    std::shared_ptr<ClientInfo>& clientEntry(int clientSocket);
+    
+    // Welcomed clients ordered by weighted load, lightest first, under
+    // loadMutex_. Its two lightest entries are republished on every change
+    // as packed <load, socket> words (socket -1 when empty), which the
+    // balancer reads without any lock; slightly stale is good enough there.
+    std::set<std::pair<double, int>> loadOrder_; // <load, socket>
+    std::mutex loadMutex_;
+    std::atomic<uint64_t> lightest_[2];
+    std::atomic<int> indexedClients_;
+    
+    // Recompute a client's load and move it in loadOrder_, after its task
+    // count, speed or link changed. Caller must hold the client's mutex.
+    void reindexLoad(int clientSocket, ClientInfo& info);
+    
+    // Take a departed client out of loadOrder_
+    void unindexLoad(int clientSocket, ClientInfo& info);
+    
+    // Copy loadOrder_'s head into lightest_. Caller must hold loadMutex_.
+    void publishLightest();
+    
+    // The least loaded client other than this one, from the published
+    // snapshot; false if there is none
+    bool lightestOther(int clientSocket, double& load) const;
+    
+    // Whether a client has a job's whole operands, mapped or broadcast.
+    // Caller must hold the client's mutex.
+    bool holdsOperands(const Job& job, int clientSocket, const ClientInfo& info) const;
+    
+    // Back up the oldest late tiles on an idle client; no job has queued work
+    std::vector<Task> assignBackups(int clientSocket, int credits);
+    
+    // Record that a client now holds a tile, under a fresh lease. Caller
+    // must hold the job's mutex and then the client's.
+    void leaseTask(Job& job, int clientSocket, ClientInfo& info, const Task& task);
+    
+    // Requeue tiles whose lease expired, or all tiles of a client that left
+    void expireLeases();
+    void releaseLeases(int clientSocket);
+    std::thread leaseThread_;
+    std::mutex leaseWakeMutex_;
+    std::condition_variable leaseWake_;
+    void leaseLoop();
+    
+    // A result arrived: release the task the client held, fold the tile's
+    // flop rate into its performance ratio and refresh its link estimates
+    void updateClientPerformance(const std::shared_ptr<Connection>& conn, const Result& result);
+    
+    // Cost model: estimated seconds for a client to turn a task around,
+    // computing at its measured flop rate and moving the operand panels it
+    // lacks (none if it holds the operands) plus the result over its link.
+    // The transfer share is returned through `transferSeconds`. Caller
+    // must hold the client's mutex.
+    double taskCost(const ClientInfo& info, bool hasOperands, const Task& task, double* transferSeconds = nullptr) const;
+    
+    // Sizing from HELLO capabilities and measured speed: the prefetch depth
+    // a client gets, and a tile edge (and inner dimension slice, 0 for
+    // none) that suit the clients connected when a job is submitted
+    void welcomeClient(const std::shared_ptr<Connection>& conn, const std::vector<char>& hello);
+    int grantPrefetchDepth(const Capabilities& caps) const;
+    int chooseTileSize(Job& job, int& sliceDepth);
+    
+    // Edge of the pieces a client's tiles are split into: the job edge for
+    // the fastest client, shrinking with the square root of relative speed.
+    int clientTileEdge(const Job& job, const ClientInfo& info) const;
+    
+    // Walks. Queue a task on its walk (false, and an assertion, if its
+    // queue is full); pop the next task of a walk; pop for a client,
+    // continuing its walk or moving to the best other one: the one whose
+    // panels it holds most of, then one nobody is on, then (stealing) the
+    // one with the most tasks left. popTask takes the client's mutex
+    // itself; leaveWalk's caller must hold it.
+    bool queueTask(Job& job, const Task& task);
+    bool popWalk(Job& job, int walk, Task& task);
+    bool popTask(Job& job, ClientInfo& info, Task& task);
+    void leaveWalk(Job& job, ClientInfo& info);
+    
+    // Cut a grid tile into pieces about `edge` on a side, each a task of its
+    // own within the tile's panels. Queues all but the first, which it
+    // returns. Caller must hold the job's mutex.
+    Task splitTask(Job& job, const Task& task, int edge);
+    
+    // Carve the next chunk for a client from the tile grid, false once all
+    // of it is handed out
+    bool carveTask(Job& job, const ClientInfo& info, Task& task);
+    
+    // Answer a (possibly piggybacked) task request with TASK_BATCH, or with
+    // NO_WORK if the client still holds tasks; it asks again once it has
+    // drained them. An idle client's request is parked instead.
+    void replyWithTasks(const std::shared_ptr<Connection>& conn, int credits);
+    
+    // Tell every client the job is over; they stay connected for the others
+    void finishJob(Job& job);
+    
+    // Operand broadcast: plan a relay tree over the clients that still need
+    // the job's A and B, stream them to its roots, and feed stragglers
+    // directly
+    void broadcastOperands(Job& job);
+    void ensureOperands(Job& job, const std::shared_ptr<Connection>& conn);
+    
+    // Create the job's segment unless it exists or could not be made;
+    // false if local clients have none. Caller must hold the job's mutex.
+    bool shareOperands(Job& job);
+    void streamOperands(const Job& job, const std::shared_ptr<Connection>& conn, size_t offset);
+    
+    // Answer a PANEL_REQUEST with one PANEL_DATA per panel
+    void sendPanels(const std::shared_ptr<Connection>& conn, const std::vector<char>& request);
+    
+    // Pop up to `credits` tasks for a client, honouring its prefetch depth
+    // and the load-balancing rules, from the jobs in priority and fair-share
+    // order. Sets `requeued` if it put tasks back on a queue (lookahead,
+    // splits, the balancer), which idle clients may want.
+    std::vector<Task> assignTasks(int clientSocket, int credits, bool *requeued = nullptr);
     
     // Connection handling methods
-    void acceptConnections();
-    void handleClient(int clientSocket, struct sockaddr_in clientAddr);
+    void ioLoop(int epollFd);
+    void uringLoop();
+    void acceptConnections(int epollFd, std::map<int, std::shared_ptr<Connection>>& owned);
+    std::shared_ptr<Connection> registerClient(int clientSocket);
+    void handleMessage(const std::shared_ptr<Connection>& conn, MessageType type, std::vector<char>& payload);
+    void closeConnection(int epollFd, const std::shared_ptr<Connection>& conn);
+    
+    // Shared-memory negotiation and the poller serving attached clients
+    void offerSharedMemory(const std::shared_ptr<Connection>& conn, const std::vector<char>& identity);
+    void attachSharedMemory(const std::shared_ptr<Connection>& conn);
+    void dropSharedMemory(const std::shared_ptr<Connection>& conn);
+    void shmLoop();
+    bool pumpSharedMemory(ShmChannel& channel);
+    void wakeShmLoop();
+    
+    // Task management: the first result for a tile lands, duplicates are dropped
+    void processResult(const Result& result, int clientSocket);
+    
+    // Count a job's tasks done, finishing it with the last of them
+    void completeTasks(Job& job, int count);
+    
+    // SUMMA: lay the clients out in a grid and send each its plan and its
+    // pieces of A and B; without two members, or while another job holds
+    // the clients' SUMMA nodes, queue the tiles instead
+    void startSumma(Job& job);
+    
+    // A member's piece of C, or word that it gave up
+    void processSummaResult(const std::vector<char>& payload, int clientSocket);
     
-    // Task management
-    void processResult(const Result& result);
+    // Queue the tiles of a member that will not deliver; returns how many.
+    // Caller must hold the job's mutex.
+    int abandonSumma(Job& job, int clientSocket);
     
     // Calculate how to divide work based on available clients
     void redistributeWork();
 
     // Tile management
-    void createTiledTasks();
-};
\ No newline at end of file
+    void createTiledTasks(Job& job);
+};
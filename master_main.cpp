@@ -23,15 +23,63 @@ Matrix generateRandomMatrix(int rows, int cols) {
 
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <port> [matrix_size=1000]\n";
+        std::cerr << "Usage: " << argv[0] << " <port|host:port|unix:/path|unix:@name> [matrix_size=1000] "
+                  << "[io_backend=epoll|uring] [operands=panels|broadcast] [jobs=1] [schedule=static|guided|summa] [order=rows|supertile|morton|hilbert]\n";
         return 1;
     }
     
-    int port = std::stoi(argv[1]);
+    Endpoint endpoint;
+    if (!Endpoint::parse(argv[1], endpoint)) {
+        std::cerr << "Invalid endpoint: " << argv[1] << "\n";
+        return 1;
+    }
     int matrixSize = (argc > 2) ? std::stoi(argv[2]) : 1000;
     
+    IoBackend ioBackend = IO_BACKEND_EPOLL;
+    if (argc > 3 && !parseIoBackend(argv[3], ioBackend)) {
+        std::cerr << "Unknown I/O backend: " << argv[3] << "\n";
+        return 1;
+    }
+    
+    OperandMode operandMode = OPERANDS_ON_DEMAND;
+    if (argc > 4) {
+        std::string mode = argv[4];
+        if (mode == "broadcast") {
+            operandMode = OPERANDS_BROADCAST;
+        } else if (mode != "panels") {
+            std::cerr << "Unknown operand mode: " << mode << "\n";
+            return 1;
+        }
+    }
+    
+    // Jobs run back to back over the same client connections
+    int jobs = (argc > 5) ? std::max(std::stoi(argv[5]), 1) : 1;
+    
+    ScheduleMode scheduleMode = SCHEDULE_STATIC;
+    if (argc > 6) {
+        std::string mode = argv[6];
+        if (mode == "guided") {
+            scheduleMode = SCHEDULE_GUIDED;
+        } else if (mode == "summa") {
+            scheduleMode = SCHEDULE_SUMMA;
+        } else if (mode != "static") {
+            std::cerr << "Unknown schedule: " << mode << "\n";
+            return 1;
+        }
+    }
+    
+    TileOrder tileOrder = TILE_ORDER_ROWS;
+    if (argc > 7 && !parseTileOrder(argv[7], tileOrder)) {
+        std::cerr << "Unknown tile order: " << argv[7] << "\n";
+        return 1;
+    }
+    
     // Create and start master
-    Master master(port);
+    Master master(endpoint);
+    master.setIoBackend(ioBackend);
+    master.setOperandMode(operandMode);
+    master.setScheduleMode(scheduleMode);
+    master.setTileOrder(tileOrder);
     master.start();
     
     // Generate random matrices
@@ -39,28 +87,27 @@ int main(int argc, char* argv[]) {
     Matrix matrixA = generateRandomMatrix(matrixSize, matrixSize);
     Matrix matrixB = generateRandomMatrix(matrixSize, matrixSize);
     
-    // Set matrices for computation
-    master.setMatrices(matrixA, matrixB);
-    
     // Wait for clients to connect
     std::cout << "\nWaiting for clients to connect...\n";
     std::cout << "Press Enter when ready to start computation with the connected clients\n";
     std::cin.get();
     
-    // Start computation with connected clients
-    master.startComputation();
-    
-    // Wait for computation to complete
-    std::cout << "Computation started. Waiting for completion...\n";
-    while (!master.isComplete()) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+    Matrix result = matrixA;
+    for (int job = 1; job <= jobs; job++) {
+        // Each further job multiplies the previous product by B, so the
+        // clients' cached B panels are reused
+        int jobId = master.submitJob(result, matrixB);
+        
+        // Wait for computation to complete
+        std::cout << "Computation started. Waiting for completion...\n";
+        master.waitForJob(jobId);
+        
+        std::cout << "Job " << job << " of " << jobs << " completed successfully!" << std::endl;
+        result = master.takeResult(jobId);
     }
     
-    std::cout << "Computation completed successfully!" << std::endl;
-    
     // Display results (for small matrices only)
     if (matrixSize <= 10) {
-        Matrix result = master.getResult();
         std::cout << "\nResult Matrix (" << result.rows() << "x" << result.cols() << "):\n";
         for (int i = 0; i < result.rows(); i++) {
             for (int j = 0; j < result.cols(); j++) {
@@ -0,0 +1,147 @@
+#include "tile_order.h"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Effect of the tile order on data movement, simulated: clients of equal
+// speed take turns asking for a task, and walks are handed out the way the
+// master does it. Each client keeps an LRU cache of operand panels; a
+// miss is a panel fetched over the network. On the master, every finished
+// tile is written into C; the pages those writes touch go through an LRU
+// the size of a typical second-level TLB.
+
+static const size_t PAGE_BYTES = 4096;
+static const size_t TLB_ENTRIES = 1536;
+
+class LruSet {
+public:
+    explicit LruSet(size_t capacity) : capacity_(capacity) {}
+
+    // True if `key` was present; either way it is now the most recent
+    bool touch(uint64_t key) {
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            order_.splice(order_.begin(), order_, it->second);
+            return true;
+        }
+        order_.push_front(key);
+        index_[key] = order_.begin();
+        if (order_.size() > capacity_) {
+            index_.erase(order_.back());
+            order_.pop_back();
+        }
+        return false;
+    }
+
+    bool contains(uint64_t key) const { return index_.count(key) > 0; }
+
+private:
+    size_t capacity_;
+    std::list<uint64_t> order_;
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> index_;
+};
+
+struct Stats {
+    long long hits = 0;
+    long long misses = 0;
+    long long pageMisses = 0;
+};
+
+static uint64_t panelKey(int kind, int index) {
+    return ((uint64_t)kind << 32) | (uint32_t)index;
+}
+
+Stats simulate(TileOrder order, int size, int tile, int clients, size_t cachePanels) {
+    int tiles = (size + tile - 1) / tile;
+    std::vector<std::pair<int, int>> sequence = enumerateTiles(order, tiles, tiles);
+    int length = walkLength(order, tiles);
+
+    // Walks as the master cuts them
+    int walkCount = ((int)sequence.size() + length - 1) / length;
+    std::vector<std::deque<std::pair<int, int>>> walks(walkCount);
+    for (size_t n = 0; n < sequence.size(); n++) {
+        walks[n / length].push_back(sequence[n]);
+    }
+    std::vector<int> walkers(walkCount, 0);
+
+    std::vector<LruSet> caches(clients, LruSet(cachePanels));
+    std::vector<int> current(clients, -1);
+    LruSet tlb(TLB_ENTRIES);
+    Stats stats;
+
+    size_t remaining = sequence.size();
+    for (int turn = 0; remaining > 0; turn = (turn + 1) % clients) {
+        int& walk = current[turn];
+        if (walk < 0 || walks[walk].empty()) {
+            // Same ranking as the master: panels held, then unclaimed, then fullest
+            if (walk >= 0) {
+                walkers[walk]--;
+            }
+            std::tuple<int, bool, size_t, int> best(-1, false, 0, -1);
+            for (int w = 0; w < walkCount; w++) {
+                if (walks[w].empty()) {
+                    continue;
+                }
+                int held = 0;
+                for (auto [i, j] : walks[w]) {
+                    held += caches[turn].contains(panelKey(0, i)) + caches[turn].contains(panelKey(1, j));
+                }
+                best = std::max(best, std::make_tuple(held, walkers[w] == 0, walks[w].size(), w));
+            }
+            walk = std::get<3>(best);
+            walkers[walk]++;
+        }
+
+        auto [i, j] = walks[walk].front();
+        walks[walk].pop_front();
+        remaining--;
+
+        for (uint64_t key : {panelKey(0, i), panelKey(1, j)}) {
+            if (caches[turn].touch(key)) {
+                stats.hits++;
+            } else {
+                stats.misses++;
+            }
+        }
+
+        // The master copies the tile into row-major C, row by row
+        for (int row = i * tile; row < std::min((i + 1) * tile, size); row++) {
+            size_t first = ((size_t)row * size + (size_t)j * tile) * sizeof(double) / PAGE_BYTES;
+            size_t last = ((size_t)row * size + std::min((j + 1) * tile, size) - 1) * sizeof(double) / PAGE_BYTES;
+            for (size_t page = first; page <= last; page++) {
+                stats.pageMisses += !tlb.touch(page);
+            }
+        }
+    }
+    return stats;
+}
+
+int main(int argc, char* argv[]) {
+    int size = (argc > 1) ? std::stoi(argv[1]) : 8192;
+    int tile = (argc > 2) ? std::stoi(argv[2]) : 128;
+    int clients = (argc > 3) ? std::stoi(argv[3]) : 4;
+    double cacheMiB = (argc > 4) ? std::stod(argv[4]) : 64;
+
+    double panelMiB = (double)tile * size * sizeof(double) / (1 << 20);
+    size_t cachePanels = std::max<size_t>((size_t)(cacheMiB / panelMiB), 2);
+
+    std::cout << size << "x" << size << " in " << tile << "x" << tile << " tiles, " << clients
+              << " clients caching " << cachePanels << " panels of " << panelMiB << " MiB\n";
+    std::cout << std::setw(10) << "order" << std::setw(12) << "hit rate" << std::setw(14) << "fetched MiB"
+              << std::setw(14) << "C page miss" << "\n";
+    for (TileOrder order : {TILE_ORDER_ROWS, TILE_ORDER_SUPERTILE, TILE_ORDER_MORTON, TILE_ORDER_HILBERT}) {
+        Stats stats = simulate(order, size, tile, clients, cachePanels);
+        std::cout << std::setw(10) << tileOrderName(order) << std::fixed << std::setprecision(3)
+                  << std::setw(12) << (double)stats.hits / (stats.hits + stats.misses)
+                  << std::setprecision(0) << std::setw(14) << stats.misses * panelMiB
+                  << std::setw(14) << stats.pageMisses << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "panel_cache.h"
+
+PanelCache::PanelCache(size_t capacityBytes)
+    : capacityBytes_(capacityBytes), usedBytes_(0), closed_(false), hits_(0), misses_(0), bytesFetched_(0) {}
+
+void PanelCache::prefetch(const std::vector<PanelKey>& panels) {
+    std::vector<PanelKey> missing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        for (const PanelKey& panel : panels) {
+            uint64_t k = key(panel);
+            if (entries_.count(k) || pending_.count(k) || gone_.count(k)) {
+                continue;
+            }
+            pending_.insert(k);
+            missing.push_back(panel);
+        }
+    }
+
+    if (!missing.empty() && fetch_) {
+        fetch_(missing);
+    }
+}
+
+std::shared_ptr<const Panel> PanelCache::acquire(const PanelKey& panel, const std::function<bool()>& abandon) {
+    uint64_t k = key(panel);
+    bool firstLook = true;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!closed_ && !gone_.count(k)) {
+        auto it = entries_.find(k);
+        if (it != entries_.end()) {
+            if (firstLook) {
+                hits_++;
+            }
+            lru_.splice(lru_.begin(), lru_, it->second.lruPosition);
+            return it->second.panel;
+        }
+        if (firstLook) {
+            misses_++;
+            firstLook = false;
+        }
+
+        // Not prefetched, or evicted again before we got to it: ask now
+        if (!pending_.count(k)) {
+            pending_.insert(k);
+            lock.unlock();
+            if (fetch_) {
+                fetch_({panel});
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (abandon && abandon()) {
+            break;
+        }
+        arrived_.wait(lock);
+    }
+
+    return nullptr;
+}
+
+void PanelCache::insert(Panel panel) {
+    uint64_t k = key({panel.kind, panel.version, panel.index, panel.slice});
+    size_t bytes = panel.data.size() * sizeof(double);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.erase(k);
+    bytesFetched_ += bytes;
+
+    auto it = entries_.find(k);
+    if (it != entries_.end()) {
+        // Requested twice; keep the copy we have
+        return;
+    }
+
+    lru_.push_front(k);
+    entries_[k] = Entry{std::make_shared<const Panel>(std::move(panel)), lru_.begin()};
+    usedBytes_ += bytes;
+    evictLocked();
+
+    arrived_.notify_all();
+}
+
+void PanelCache::gone(const std::vector<PanelKey>& panels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const PanelKey& panel : panels) {
+        pending_.erase(key(panel));
+        gone_.insert(key(panel));
+    }
+    arrived_.notify_all();
+}
+
+void PanelCache::wake() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    arrived_.notify_all();
+}
+
+void PanelCache::evictLocked() {
+    // Never evict the panel that was just inserted
+    while (usedBytes_ > capacityBytes_ && lru_.size() > 1) {
+        uint64_t victim = lru_.back();
+        lru_.pop_back();
+
+        auto it = entries_.find(victim);
+        usedBytes_ -= it->second.panel->data.size() * sizeof(double);
+        entries_.erase(it);
+    }
+}
+
+void PanelCache::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    arrived_.notify_all();
+}
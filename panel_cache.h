@@ -0,0 +1,77 @@
+#pragma once
+#include "common.h"
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+// Client-side cache of operand panels fetched on demand.
+//
+// Tasks name the A row panel and B column panel they need. The receiver
+// prefetches missing panels as soon as a task batch arrives, so by the
+// time the compute stage gets to a task its panels are usually there.
+// Panels are evicted least-recently-used once the cache exceeds its byte
+// budget; a task holding a panel keeps it alive regardless. Keys carry the
+// operand version, so the cache outlives jobs: panels of an operand that a
+// later job reuses are hits, stale ones simply age out.
+class PanelCache {
+public:
+    using Fetch = std::function<void(const std::vector<PanelKey>&)>;
+
+    explicit PanelCache(size_t capacityBytes);
+
+    // Called outside the lock to request panels from the master
+    void setFetcher(Fetch fetch) { fetch_ = std::move(fetch); }
+
+    // Request whichever of these panels are neither cached nor on their way
+    void prefetch(const std::vector<PanelKey>& panels);
+
+    // Block until the panel is available. nullptr once closed, once the
+    // master reports the panel gone, or once `abandon` (checked whenever
+    // waiters are woken) says its task is no longer wanted.
+    std::shared_ptr<const Panel> acquire(const PanelKey& panel, const std::function<bool()>& abandon = nullptr);
+
+    // A panel arrived from the master
+    void insert(Panel panel);
+
+    // The master no longer holds these panels' operands; fail their waiters
+    void gone(const std::vector<PanelKey>& panels);
+
+    // Have every waiter check its `abandon` again
+    void wake();
+
+    // Wake and fail every waiter
+    void close();
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t bytesFetched() const { return bytesFetched_; }
+
+private:
+    static uint64_t key(const PanelKey& panel) { return panelKeyId(panel); }
+    void evictLocked();
+
+    struct Entry {
+        std::shared_ptr<const Panel> panel;
+        std::list<uint64_t>::iterator lruPosition;
+    };
+
+    size_t capacityBytes_;
+    size_t usedBytes_;
+    Fetch fetch_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable arrived_;
+    std::unordered_map<uint64_t, Entry> entries_;
+    std::list<uint64_t> lru_;                // Most recently used first
+    std::unordered_set<uint64_t> pending_;   // Requested, not yet arrived
+    std::unordered_set<uint64_t> gone_;      // The master cannot send them
+    bool closed_;
+
+    size_t hits_;
+    size_t misses_;
+    size_t bytesFetched_;
+};
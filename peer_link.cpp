@@ -0,0 +1,91 @@
+#include "peer_link.h"
+#include "common.h"
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+
+// How often a waiting acceptor checks whether its job was abandoned
+static const int PEER_ACCEPT_SLICE_MS = 100;
+
+// How long a new peer has to send its hello
+static const int PEER_HELLO_TIMEOUT_MS = 1000;
+
+int listenAnyPort(int backlog, int& port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = 0;
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, backlog) < 0 ||
+        getsockname(fd, (struct sockaddr*)&addr, &addrLen) < 0) {
+        close(fd);
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+int connectPeer(const std::string& host, int port, const void* hello, size_t len) {
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    bool connected = fd >= 0 && inet_pton(AF_INET, host.c_str(), &addr.sin_addr) > 0 &&
+                     connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+                     send(fd, hello, len, MSG_NOSIGNAL) == (ssize_t)len;
+    if (!connected && fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+int acceptPeer(int listenFd, std::chrono::steady_clock::time_point deadline, const std::function<bool()>& active) {
+    while (active()) {
+        int left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            break;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = listenFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, std::min(left, PEER_ACCEPT_SLICE_MS));
+        if (ready == 0 || (ready < 0 && errno == EINTR)) {
+            continue;
+        }
+        if (ready < 0 || (pfd.revents & (POLLERR | POLLHUP))) {
+            break;
+        }
+
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd >= 0) {
+            return fd;
+        }
+    }
+    return -1;
+}
+
+bool receiveHello(int fd, void* hello, size_t len) {
+    setReceiveTimeout(fd, PEER_HELLO_TIMEOUT_MS);
+    return recv(fd, hello, len, MSG_WAITALL) == (ssize_t)len;
+}
+
+void setReceiveTimeout(int fd, int ms) {
+    struct timeval timeout;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_usec = (ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// TCP links between clients, shared by the operand relay and SUMMA nodes.
+// A client listens on an ephemeral port the master passes on to its peers;
+// a peer connects and first sends a small hello naming the job it expects,
+// so the listener can turn away one still trying for an earlier job.
+
+// Listen on any interface and any free port; returns the socket and sets
+// `port`, or -1
+int listenAnyPort(int backlog, int& port);
+
+// Connect to host:port and send `hello`; returns the socket, or -1
+int connectPeer(const std::string& host, int port, const void* hello, size_t len);
+
+// Accept the next connection before `deadline`, rechecking `active` every
+// slice so an abandoned job stops waiting. Returns the socket, or -1 once
+// the deadline passed, `active` turned false or the listener failed.
+int acceptPeer(int listenFd, std::chrono::steady_clock::time_point deadline, const std::function<bool()>& active);
+
+// Read the hello a peer sends right after connecting; false if it does not
+// arrive in time
+bool receiveHello(int fd, void* hello, size_t len);
+
+// Give up on a recv after `ms` milliseconds without data
+void setReceiveTimeout(int fd, int ms);
@@ -0,0 +1,91 @@
+#include "common.h"
+#include "mpmc_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+// Task-dispatch throughput: N threads drain a queue of tasks the way the
+// master's request handlers do, occasionally putting a task back (the
+// lookahead of transfer-bound clients). Compares the lock-free MpmcQueue
+// against the std::deque plus mutex it replaced.
+
+// Every LOOKAHEAD_EVERY-th pop returns its task to the tail
+static const int LOOKAHEAD_EVERY = 8;
+
+class LockedQueue {
+public:
+    bool tryPush(Task task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(task);
+        return true;
+    }
+
+    bool tryPop(Task& task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) {
+            return false;
+        }
+        task = tasks_.front();
+        tasks_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<Task> tasks_;
+};
+
+// Millions of dispatches per second with `threads` concurrent requesters
+template <typename Queue>
+double measure(Queue& queue, int tasks, int threads) {
+    for (int i = 0; i < tasks; i++) {
+        Task task = {};
+        task.taskId = i;
+        queue.tryPush(task);
+    }
+
+    std::atomic<long long> dispatches(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&queue, &dispatches]() {
+            Task task;
+            long long pops = 0;
+            while (queue.tryPop(task)) {
+                if (++pops % LOOKAHEAD_EVERY == 0 && task.taskId >= 0) {
+                    // Put it back once, marked so it is not recycled forever
+                    task.taskId = -1 - task.taskId;
+                    queue.tryPush(task);
+                }
+            }
+            dispatches += pops;
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return dispatches / seconds / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+    int tasks = (argc > 1) ? std::stoi(argv[1]) : 1 << 20;
+    int maxThreads = (argc > 2) ? std::stoi(argv[2]) : (int)std::max(std::thread::hardware_concurrency(), 2u);
+
+    std::cout << "Dispatching " << tasks << " tasks (Mops/s)\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "mutex+deque" << std::setw(14) << "mpmc" << "\n";
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        LockedQueue locked;
+        MpmcQueue<Task> lockFree(tasks + tasks / LOOKAHEAD_EVERY + 1);
+        double lockedRate = measure(locked, tasks, threads);
+        double lockFreeRate = measure(lockFree, tasks, threads);
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+                  << std::setw(14) << lockedRate << std::setw(14) << lockFreeRate << "\n";
+    }
+    return 0;
+}
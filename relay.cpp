@@ -0,0 +1,274 @@
+#include "relay.h"
+#include "peer_link.h"
+#include <algorithm>
+#include <chrono>
+
+// How long a relay waits for its children to connect before giving up on
+// the missing ones; they fall back to the master
+static const int RELAY_ACCEPT_TIMEOUT_MS = 5000;
+
+// A parent that sends nothing for this long is treated as lost
+static const int RELAY_STALL_TIMEOUT_MS = 10000;
+
+OperandRelay::OperandRelay()
+    : listenFd_(-1), upstreamFd_(-1), running_(true), abandon_(false), planned_(false),
+      data_(std::make_shared<std::vector<char>>()), received_(0), ready_(false) {}
+
+OperandRelay::~OperandRelay() {
+    stop();
+}
+
+int OperandRelay::listen() {
+    // The master tells children which port
+    int port = 0;
+    int fd = listenAnyPort(BROADCAST_FANOUT * 2, port);
+    if (fd < 0) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    listenFd_ = fd;
+    return port;
+}
+
+void OperandRelay::begin(const BroadcastPlan& plan, Fallback fallback) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (planned_ && plan_.jobId == plan.jobId) {
+            return;
+        }
+    }
+
+    // The previous job is over. A leftover tile of it may still be reading
+    // its operands, so they get a new buffer rather than being overwritten.
+    endJob();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        plan_ = plan;
+        fallback_ = std::move(fallback);
+        size_t elements = (size_t)plan.rowsA * plan.colsA + (size_t)plan.rowsB * plan.colsB;
+        data_ = std::make_shared<std::vector<char>>(elements * sizeof(double), 0);
+        received_ = 0;
+        planned_ = true;
+        ready_ = data_->empty();
+    }
+    progress_.notify_all();  // Waiters on the previous job's operands give up
+
+    if (plan.children > 0) {
+        acceptThread_ = std::thread(&OperandRelay::acceptChildren, this, plan.children, plan.jobId);
+    }
+
+    if (!plan.parentHost.empty()) {
+        upstreamThread_ = std::thread(&OperandRelay::upstreamLoop, this, plan.parentHost, plan.parentPort, plan.jobId);
+    }
+}
+
+void OperandRelay::deliver(size_t offset, const char* bytes, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!planned_ || offset > received_) {
+        return;  // Chunks always arrive in order; a gap means a stale stream
+    }
+
+    // Skip whatever we already have (e.g. a fallback stream overlapping the parent's)
+    size_t end = std::min(offset + len, data_->size());
+    if (end <= received_) {
+        return;
+    }
+    std::memcpy(data_->data() + received_, bytes + (received_ - offset), end - received_);
+    received_ = end;
+
+    if (complete()) {
+        ready_ = true;
+    }
+    progress_.notify_all();
+}
+
+
+bool OperandRelay::planned(int jobId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return planned_ && plan_.jobId == jobId;
+}
+
+std::shared_ptr<const std::vector<char>> OperandRelay::operands(int jobId, MatrixView& a, MatrixView& b) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    progress_.wait(lock, [&]() { return complete() || !running_ || plan_.jobId != jobId; });
+    if (!complete() || plan_.jobId != jobId) {
+        return nullptr;
+    }
+
+    const double* base = reinterpret_cast<const double*>(data_->data());
+    a = {base, plan_.rowsA, plan_.colsA};
+    b = {base + (size_t)plan_.rowsA * plan_.colsA, plan_.rowsB, plan_.colsB};
+    return data_;
+}
+
+void OperandRelay::upstreamLoop(std::string host, int port, int jobId) {
+    // Name our job so a parent still on an older one turns us away
+    int fd = connectPeer(host, port, &jobId, sizeof(jobId));
+    bool connected = fd >= 0;
+    if (connected) {
+        setReceiveTimeout(fd, RELAY_STALL_TIMEOUT_MS);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        upstreamFd_ = active() ? fd : -1;
+        connected = active();
+    }
+
+    // Receive until the operands are complete or the parent goes away
+    while (connected && active() && !ready_) {
+        auto [msgType, payload] = NetworkMessage::receiveMessage(fd);
+        if (msgType != OPERAND_CHUNK) {
+            break;
+        }
+        const char* bytes;
+        size_t len;
+        size_t offset = NetworkMessage::deserializeOperandChunk(payload, bytes, len);
+        deliver(offset, bytes, len);
+    }
+
+    size_t resumeAt = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        upstreamFd_ = -1;
+        resumeAt = received_;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (active() && !ready_) {
+        std::cerr << "Lost operand relay " << host << ":" << port
+                  << ", fetching the rest from the master\n";
+        fallback_(resumeAt);
+    }
+}
+
+void OperandRelay::acceptChildren(int count, int jobId) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RELAY_ACCEPT_TIMEOUT_MS);
+    int accepted = 0;
+
+    while (accepted < count) {
+        int childFd = acceptPeer(listenFd_, deadline, [this]() { return active(); });
+        if (childFd < 0) {
+            break;
+        }
+
+        // A child that gave up on an earlier job may still sit in the backlog
+        int childJob;
+        if (!receiveHello(childFd, &childJob, sizeof(childJob)) || childJob != jobId) {
+            close(childFd);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!active()) {
+            close(childFd);
+            break;
+        }
+        childFds_.push_back(childFd);
+        forwardThreads_.emplace_back(&OperandRelay::forwardLoop, this, childFd);
+        accepted++;
+    }
+
+    // Children that connect later wait until they give up on us and fall
+    // back to the master; the listener stays open for the next job
+    if (accepted < count && active()) {
+        std::cerr << "Only " << accepted << " of " << count << " relay children connected\n";
+    }
+}
+
+void OperandRelay::forwardLoop(int childFd) {
+    size_t sent = 0;
+    std::shared_ptr<const std::vector<char>> data;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        data = data_;
+    }
+
+    while (true) {
+        // Wait for bytes the child has not seen yet
+        size_t available;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            progress_.wait(lock, [&]() { return received_ > sent || !active(); });
+            if (!active()) {
+                break;
+            }
+            available = received_;
+        }
+
+        // data_ below `available` no longer changes, so send it unlocked
+        bool ok = true;
+        while (ok && sent < available) {
+            size_t len = std::min<size_t>(BROADCAST_CHUNK_SIZE, available - sent);
+            ok = NetworkMessage::sendMessage(childFd, OPERAND_CHUNK,
+                                             NetworkMessage::serializeOperandChunk(sent, data->data() + sent, len));
+            sent += len;
+        }
+        if (!ok || sent == data->size()) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    childFds_.erase(std::remove(childFds_.begin(), childFds_.end(), childFd), childFds_.end());
+    close(childFd);
+}
+
+void OperandRelay::endJob() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abandon_ = true;
+
+        // Wake every thread blocked in recv or send; the acceptor polls
+        if (upstreamFd_ >= 0) {
+            shutdown(upstreamFd_, SHUT_RDWR);
+        }
+        for (int fd : childFds_) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    progress_.notify_all();
+
+    if (upstreamThread_.joinable()) {
+        upstreamThread_.join();
+    }
+    if (acceptThread_.joinable()) {
+        acceptThread_.join();
+    }
+
+    // The acceptor is gone, so the list no longer grows
+    std::vector<std::thread> forwarders;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        forwarders.swap(forwardThreads_);
+    }
+    for (std::thread& forwarder : forwarders) {
+        forwarder.join();
+    }
+
+    abandon_ = false;
+}
+
+void OperandRelay::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        if (listenFd_ >= 0) {
+            shutdown(listenFd_, SHUT_RDWR);
+        }
+    }
+    progress_.notify_all();
+
+    endJob();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (listenFd_ >= 0) {
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Client side of the operand broadcast tree.
+//
+// The master streams A and B to only BROADCAST_FANOUT clients; every client
+// forwards the chunks it has received to up to BROADCAST_FANOUT children of
+// its own while the rest is still arriving. The master then sends each byte
+// about BROADCAST_FANOUT times however many clients there are, and the
+// pipelining keeps the distribution time close to one transfer plus a small
+// per-level delay.
+//
+// Children connect to their parent's relay listener and name the job they
+// expect. A child that cannot reach its parent, or loses it mid-stream, asks
+// the master for the rest. The listener lives for the whole session; each
+// job's plan replaces the previous job's operands and relay threads. A
+// buffer that is replaced lives on while a tile still multiplies from it.
+class OperandRelay {
+public:
+    // Called (from a relay thread) to get operands from `offset` on from the master
+    using Fallback = std::function<void(size_t offset)>;
+
+    OperandRelay();
+    ~OperandRelay();
+
+    OperandRelay(const OperandRelay&) = delete;
+    OperandRelay& operator=(const OperandRelay&) = delete;
+
+    // Open the relay listener; returns its TCP port, or 0 if relaying is off
+    int listen();
+
+    // Drop the previous job, size the operands and start the
+    // upstream/downstream threads
+    void begin(const BroadcastPlan& plan, Fallback fallback);
+
+    // Operand bytes arrived, from the master connection or the parent
+    void deliver(size_t offset, const char* bytes, size_t len);
+
+    // True once a BROADCAST_PLAN made this client part of the job's broadcast
+    bool planned(int jobId) const;
+
+    // Block until all of the job's operands arrived, and point `a` and `b`
+    // at them; they stay valid while the returned buffer is held. nullptr
+    // if the relay stopped or another job's plan replaced this one.
+    std::shared_ptr<const std::vector<char>> operands(int jobId, MatrixView& a, MatrixView& b);
+
+    // Close every relay socket and join the threads
+    void stop();
+
+private:
+    void upstreamLoop(std::string host, int port, int jobId);
+    void acceptChildren(int count, int jobId);
+    void forwardLoop(int childFd);
+    bool complete() const { return planned_ && received_ == data_->size(); }
+    bool active() const { return running_ && !abandon_; }
+
+    // Wake and join the current job's threads; the listener stays open
+    void endJob();
+
+    int listenFd_;
+    int upstreamFd_;
+    std::atomic<bool> running_;
+    std::atomic<bool> abandon_;  // The current job's threads should give up
+
+    mutable std::mutex mutex_;
+    std::condition_variable progress_;
+    BroadcastPlan plan_;
+    bool planned_;
+    std::shared_ptr<std::vector<char>> data_;  // A's elements, then B's
+    size_t received_;         // Contiguous prefix of data_ filled so far
+    std::atomic<bool> ready_;
+    Fallback fallback_;
+
+    std::thread upstreamThread_;
+    std::thread acceptThread_;
+    std::vector<std::thread> forwardThreads_;  // Guarded by mutex_
+    std::vector<int> childFds_;                // Guarded by mutex_
+};
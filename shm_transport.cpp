@@ -0,0 +1,381 @@
+#include "shm_transport.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <tuple>
+
+// Marks a job segment written by this version of the master
+static const uint64_t SHM_JOB_MAGIC = 0x646973746d6d3031ULL;  // "distmm01"
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+size_t ShmRing::write(const char* src, size_t len) {
+    uint64_t tailPos = tail.load(std::memory_order_relaxed);
+    uint64_t headPos = head.load(std::memory_order_acquire);
+    size_t count = std::min<size_t>(len, capacity - (tailPos - headPos));
+
+    // Copy in up to two pieces when the write wraps around the end
+    size_t offset = tailPos & (capacity - 1);
+    size_t first = std::min(count, capacity - offset);
+    std::memcpy(data + offset, src, first);
+    std::memcpy(data, src + first, count - first);
+
+    tail.store(tailPos + count, std::memory_order_release);
+    return count;
+}
+
+size_t ShmRing::readable(const char*& src) const {
+    uint64_t headPos = head.load(std::memory_order_relaxed);
+    uint64_t tailPos = tail.load(std::memory_order_acquire);
+    size_t offset = headPos & (capacity - 1);
+    src = data + offset;
+    return std::min<size_t>(tailPos - headPos, capacity - offset);
+}
+
+void ShmRing::consume(size_t len) {
+    head.store(head.load(std::memory_order_relaxed) + len, std::memory_order_release);
+}
+
+static size_t ringSize() {
+    return alignUp(offsetof(ShmRing, data) + SHM_RING_CAPACITY, 64);
+}
+
+size_t shmChannelSize() {
+    return 2 * ringSize();
+}
+
+ShmRing* shmRing(char* channelBase, bool toClient) {
+    return reinterpret_cast<ShmRing*>(channelBase + (toClient ? 0 : ringSize()));
+}
+
+void shmInitChannel(char* channelBase) {
+    for (bool toClient : {true, false}) {
+        ShmRing* ring = shmRing(channelBase, toClient);
+        ring->head.store(0);
+        ring->tail.store(0);
+        ring->capacity = SHM_RING_CAPACITY;
+    }
+}
+
+std::string shmHostIdentity() {
+    // Changes with every boot and differs between machines
+    char buffer[64] = {0};
+    FILE* fp = fopen("/proc/sys/kernel/random/boot_id", "r");
+    if (!fp) {
+        return "";
+    }
+    if (!fgets(buffer, sizeof(buffer), fp)) {
+        buffer[0] = '\0';
+    }
+    fclose(fp);
+    return std::string(buffer, strcspn(buffer, "\n"));
+}
+
+void ShmBackoff::pause() {
+    if (idle_ < kSpinLimit) {
+        _mm_pause();
+    } else if (idle_ < kYieldLimit) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        return;
+    }
+    idle_++;
+}
+
+ShmSegment::ShmSegment() : data_(nullptr), size_(0), linked_(false) {}
+
+ShmSegment::~ShmSegment() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+    unlink();
+}
+
+bool ShmSegment::create(const std::string& name, size_t size) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    name_ = name;
+    linked_ = true;
+
+    // ftruncate zero-fills, so C starts out cleared
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        unlink();
+        return false;
+    }
+
+    data_ = static_cast<char*>(data);
+    size_ = size;
+    return true;
+}
+
+bool ShmSegment::open(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    name_ = name;
+    data_ = static_cast<char*>(data);
+    size_ = st.st_size;
+    return true;
+}
+
+void ShmSegment::unlink() {
+    if (linked_) {
+        shm_unlink(name_.c_str());
+        linked_ = false;
+    }
+}
+
+bool ShmJob::create(const std::string& name, const Matrix& a, const Matrix& b) {
+    size_t bytesA = (size_t)a.rows() * a.cols() * sizeof(double);
+    size_t bytesB = (size_t)b.rows() * b.cols() * sizeof(double);
+    size_t bytesC = (size_t)a.rows() * b.cols() * sizeof(double);
+
+    // Cache-line aligned regions so tiles written by different clients do
+    // not share lines with the operands
+    ShmJobHeader header;
+    header.magic = SHM_JOB_MAGIC;
+    header.rowsA = a.rows();
+    header.colsA = a.cols();
+    header.rowsB = b.rows();
+    header.colsB = b.cols();
+    header.offsetA = alignUp(sizeof(ShmJobHeader), 64);
+    header.offsetB = alignUp(header.offsetA + bytesA, 64);
+    header.offsetC = alignUp(header.offsetB + bytesB, 64);
+
+    if (!segment_.create(name, header.offsetC + bytesC)) {
+        return false;
+    }
+
+    std::memcpy(segment_.data() + header.offsetA, a.data(), bytesA);
+    std::memcpy(segment_.data() + header.offsetB, b.data(), bytesB);
+    std::memcpy(segment_.data(), &header, sizeof(header));
+    return true;
+}
+
+MatrixView ShmJob::result() const {
+    const ShmJobHeader* h = header();
+    return {reinterpret_cast<const double*>(segment_.data() + h->offsetC), h->rowsA, h->colsB};
+}
+
+ShmTransport::ShmTransport(int sockfd) : socket_(sockfd), job_(nullptr), inbound_(nullptr), outbound_(nullptr) {}
+
+std::unique_ptr<Transport> ShmTransport::negotiate(Transport& current, int sockfd) {
+    std::string identity = shmHostIdentity();
+    if (identity.empty()) {
+        return nullptr;
+    }
+
+    std::vector<char> request(identity.begin(), identity.end());
+    if (!current.sendMessage(SHM_REQUEST, request)) {
+        return nullptr;
+    }
+
+    // The offer carries both segment names, each NUL-terminated; the job
+    // name is empty while no job runs. JOB_STARTs sent ahead of it are
+    // handed on, as the client maps every running job's segment.
+    std::vector<std::vector<char>> announced;
+    auto [msgType, payload] = current.receiveMessage();
+    while (msgType == JOB_START) {
+        announced.push_back(std::move(payload));
+        std::tie(msgType, payload) = current.receiveMessage();
+    }
+    if (msgType != SHM_OFFER) {
+        return nullptr;
+    }
+    std::string jobName(payload.data(), strnlen(payload.data(), payload.size()));
+    std::string channelName;
+    if (jobName.size() + 1 < payload.size()) {
+        const char* rest = payload.data() + jobName.size() + 1;
+        channelName.assign(rest, strnlen(rest, payload.size() - jobName.size() - 1));
+    }
+
+    std::unique_ptr<ShmTransport> transport(new ShmTransport(sockfd));
+    if (!transport->attach(jobName, channelName)) {
+        std::cerr << "Could not map shared memory, staying on the socket\n";
+        current.sendMessage(SHM_DECLINE, {});
+        return nullptr;
+    }
+
+    if (!current.sendMessage(SHM_ATTACHED, {})) {
+        return nullptr;
+    }
+    for (std::vector<char>& jobStart : announced) {
+        transport->received_.emplace_back(JOB_START, std::move(jobStart));
+    }
+    return std::move(transport);
+}
+
+bool ShmTransport::attach(const std::string& jobName, const std::string& channelName) {
+    if (!jobName.empty()) {
+        std::unique_ptr<ShmSegment> job = openJob(jobName);
+        if (!job) {
+            return false;
+        }
+        job_ = job.get();
+        jobs_[jobName] = std::move(job);
+    }
+    if (!channel_.open(channelName) || channel_.size() < shmChannelSize()) {
+        return false;
+    }
+
+    inbound_ = shmRing(channel_.data(), true);
+    outbound_ = shmRing(channel_.data(), false);
+    return true;
+}
+
+std::unique_ptr<ShmSegment> ShmTransport::openJob(const std::string& name) {
+    std::unique_ptr<ShmSegment> job(new ShmSegment);
+    if (!job->open(name) || job->size() < sizeof(ShmJobHeader)) {
+        return nullptr;
+    }
+
+    const ShmJobHeader* header = reinterpret_cast<const ShmJobHeader*>(job->data());
+    if (header->magic != SHM_JOB_MAGIC ||
+        header->offsetC + (size_t)header->rowsA * header->colsB * sizeof(double) > job->size()) {
+        return nullptr;
+    }
+    return job;
+}
+
+bool ShmTransport::writeAll(const char* data, size_t len) {
+    ShmBackoff backoff;
+    while (len > 0) {
+        size_t written = outbound_->write(data, len);
+        if (written > 0) {
+            data += written;
+            len -= written;
+            backoff.reset();
+            continue;
+        }
+
+        // Ring full: the master is behind, or gone
+        if (backoff.sleeping() && socketClosed()) {
+            return false;
+        }
+        backoff.pause();
+    }
+    return true;
+}
+
+bool ShmTransport::sendMessage(MessageType type, const std::vector<char>& payload) {
+    std::lock_guard<std::mutex> lock(sendMutex_);
+
+    // Frame in place: header, then the payload straight from the caller
+    char header[sizeof(MessageType) + sizeof(size_t)];
+    size_t payloadSize = payload.size();
+    std::memcpy(header, &type, sizeof(MessageType));
+    std::memcpy(header + sizeof(MessageType), &payloadSize, sizeof(size_t));
+
+    return writeAll(header, sizeof(header)) && writeAll(payload.data(), payloadSize);
+}
+
+std::pair<MessageType, std::vector<char>> ShmTransport::receiveMessage() {
+    auto onMessage = [this](MessageType type, std::vector<char>& payload) {
+        received_.emplace_back(type, std::move(payload));
+    };
+
+    ShmBackoff backoff;
+    while (received_.empty()) {
+        const char* data;
+        size_t len = inbound_->readable(data);
+        if (len > 0) {
+            reader_.feed(data, len, onMessage);
+            inbound_->consume(len);
+            backoff.reset();
+            continue;
+        }
+
+        // Idle: only now is a syscall to check the socket affordable
+        if (backoff.sleeping() && socketClosed()) {
+            return {CLIENT_DISCONNECT, {}};
+        }
+        backoff.pause();
+    }
+
+    auto message = std::move(received_.front());
+    received_.pop_front();
+    return message;
+}
+
+bool ShmTransport::socketClosed() const {
+    char probe;
+    ssize_t received = recv(socket_, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (received < 0) {
+        return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+    }
+    return received == 0;
+}
+
+bool ShmTransport::sharedOperands(MatrixView& a, MatrixView& b) const {
+    if (!job_) {
+        return false;
+    }
+    const ShmJobHeader* header = reinterpret_cast<const ShmJobHeader*>(job_->data());
+    a = {reinterpret_cast<const double*>(job_->data() + header->offsetA), header->rowsA, header->colsA};
+    b = {reinterpret_cast<const double*>(job_->data() + header->offsetB), header->rowsB, header->colsB};
+    return true;
+}
+
+double* ShmTransport::sharedResult(int& cols) const {
+    if (!job_) {
+        return nullptr;
+    }
+    const ShmJobHeader* header = reinterpret_cast<const ShmJobHeader*>(job_->data());
+    cols = header->colsB;
+    return reinterpret_cast<double*>(job_->data() + header->offsetC);
+}
+
+void ShmTransport::switchJob(const std::string& sharedName) {
+    // Called by the compute stage between tiles, so no task still reads the
+    // previous mapping; it stays mapped for that job's later tasks. Without
+    // one, tasks fall back to operands over the rings.
+    job_ = nullptr;
+    if (sharedName.empty()) {
+        return;
+    }
+    auto it = jobs_.find(sharedName);
+    if (it == jobs_.end()) {
+        it = jobs_.emplace(sharedName, openJob(sharedName)).first;
+        if (!it->second) {
+            std::cerr << "Could not map job segment " << sharedName << ", fetching operands instead\n";
+        }
+    }
+    job_ = it->second.get();
+}
+
+void ShmTransport::releaseJob(const std::string& sharedName) {
+    auto it = jobs_.find(sharedName);
+    if (it == jobs_.end()) {
+        return;
+    }
+    if (job_ == it->second.get()) {
+        job_ = nullptr;
+    }
+    jobs_.erase(it);
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "common.h"
+#include "connection.h"
+#include "transport.h"
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+
+// Shared-memory transport for clients running on the same host as the master.
+//
+// The master keeps A, B and the result C in one POSIX shared-memory "job
+// segment" that every local client maps; clients read operands from it and
+// write result tiles straight into C. Control messages (tasks, results,
+// credits) keep the normal wire format but travel through a pair of
+// lock-free SPSC byte rings in a per-client "channel segment", so a busy
+// client makes no syscalls per tile. The TCP socket stays open only so
+// either side notices when the other goes away.
+//
+// Negotiation, right after HELLO:
+//   client -> SHM_REQUEST(host identity)
+//   master -> SHM_OFFER(job segment, channel segment) or SHM_DECLINE
+//   client -> SHM_ATTACHED, after which both sides switch to the rings,
+//             or SHM_DECLINE if mapping failed and TCP is kept
+//
+// The channel lasts for the whole session; every job gets a fresh job
+// segment, named in JOB_START. Jobs may run side by side, so the client
+// keeps each running job's segment mapped and switches task by task.
+
+// Layout at the start of the job segment
+struct ShmJobHeader {
+    uint64_t magic;
+    int rowsA, colsA;
+    int rowsB, colsB;
+    uint64_t offsetA, offsetB, offsetC;  // Byte offsets of the three matrices
+};
+
+// Single-producer/single-consumer byte ring living in shared memory
+struct ShmRing {
+    alignas(64) std::atomic<uint64_t> head;  // Consumer position
+    alignas(64) std::atomic<uint64_t> tail;  // Producer position
+    uint64_t capacity;                       // Power of two
+    alignas(64) char data[1];
+
+    // Producer: copy up to len bytes in; returns how many fit
+    size_t write(const char* src, size_t len);
+
+    // Consumer: the contiguous readable bytes, then release them once used
+    size_t readable(const char*& src) const;
+    void consume(size_t len);
+};
+
+// Bytes per ring in a channel segment
+#define SHM_RING_CAPACITY (4u << 20)
+
+// Channel segment layout: master-to-client ring, then client-to-master ring
+size_t shmChannelSize();
+ShmRing* shmRing(char* channelBase, bool toClient);
+void shmInitChannel(char* channelBase);
+
+// Identifies the running kernel; both ends agree only on the same host
+std::string shmHostIdentity();
+
+// Spin, then yield, then sleep while a ring stays idle
+class ShmBackoff {
+public:
+    ShmBackoff() : idle_(0) {}
+
+    void reset() { idle_ = 0; }
+    void pause();
+
+    // Past the spinning phase; callers may afford a syscall per round
+    bool sleeping() const { return idle_ >= kYieldLimit; }
+
+private:
+    static const unsigned kSpinLimit = 256;
+    static const unsigned kYieldLimit = 512;
+    unsigned idle_;
+};
+
+// A named POSIX shared-memory mapping
+class ShmSegment {
+public:
+    ShmSegment();
+    ~ShmSegment();
+
+    ShmSegment(const ShmSegment&) = delete;
+    ShmSegment& operator=(const ShmSegment&) = delete;
+
+    // Create a zero-filled segment; the creator unlinks the name when done
+    bool create(const std::string& name, size_t size);
+    bool open(const std::string& name);
+
+    // Remove the name once every peer has mapped it; mappings stay valid
+    void unlink();
+
+    char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& name() const { return name_; }
+
+private:
+    std::string name_;
+    char* data_;
+    size_t size_;
+    bool linked_;
+};
+
+// Master side: the job segment holding A, B and the result C
+class ShmJob {
+public:
+    // Creates the segment and copies A and B into it
+    bool create(const std::string& name, const Matrix& a, const Matrix& b);
+
+    const std::string& name() const { return segment_.name(); }
+    const ShmJobHeader* header() const { return reinterpret_cast<const ShmJobHeader*>(segment_.data()); }
+    MatrixView result() const;
+
+private:
+    ShmSegment segment_;
+};
+
+// Client side transport over a negotiated channel
+class ShmTransport : public Transport {
+public:
+    // Try to upgrade an established connection. Returns nullptr, leaving
+    // `current` in charge, when the master declines or mapping fails.
+    static std::unique_ptr<Transport> negotiate(Transport& current, int sockfd);
+
+    bool sendMessage(MessageType type, const std::vector<char>& payload) override;
+    std::pair<MessageType, std::vector<char>> receiveMessage() override;
+    IoBackend backend() const override { return IO_BACKEND_SHM; }
+
+    bool sharedOperands(MatrixView& a, MatrixView& b) const override;
+    double* sharedResult(int& cols) const override;
+    void switchJob(const std::string& sharedName) override;
+    void releaseJob(const std::string& sharedName) override;
+
+private:
+    explicit ShmTransport(int sockfd);
+    bool attach(const std::string& jobName, const std::string& channelName);
+    static std::unique_ptr<ShmSegment> openJob(const std::string& name);
+    bool writeAll(const char* data, size_t len);
+    bool socketClosed() const;
+
+    int socket_;
+    std::map<std::string, std::unique_ptr<ShmSegment>> jobs_;  // Null where mapping failed
+    ShmSegment* job_;  // The current task's, null while its job is not shared
+    ShmSegment channel_;
+    ShmRing* inbound_;
+    ShmRing* outbound_;
+
+    std::mutex sendMutex_;
+    MessageReader reader_;
+    std::deque<std::pair<MessageType, std::vector<char>>> received_;
+};
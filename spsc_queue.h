@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Bounded single-producer/single-consumer ring buffer.
+// tryPush/tryPop are lock-free; push/pop spin briefly and then park on a
+// condition variable, so an idle stage costs no CPU. The mutex is only
+// touched when one side is actually parked.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : head_(0), tail_(0), closed_(false), waiters_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer_.resize(size);
+        mask_ = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side
+    bool tryPush(T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) {
+            return false;  // Full
+        }
+        buffer_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_seq_cst);
+        wakeWaiters();
+        return true;
+    }
+
+    // Blocks while the queue is full; returns false if the queue was closed
+    bool push(T item) {
+        for (int spins = 0; !tryPush(item); spins++) {
+            if (closed_) {
+                return false;
+            }
+            if (spins < kSpinLimit) {
+                continue;
+            }
+            park([this]() { return tail_.load() - head_.load() <= mask_ || closed_; });
+        }
+        return true;
+    }
+
+    // Consumer side
+    bool tryPop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;  // Empty
+        }
+        item = std::move(buffer_[head & mask_]);
+        head_.store(head + 1, std::memory_order_seq_cst);
+        wakeWaiters();
+        return true;
+    }
+
+    // Blocks until an item is available; returns false once closed and drained
+    bool pop(T& item) {
+        for (int spins = 0; !tryPop(item); spins++) {
+            if (closed_ && empty()) {
+                return false;
+            }
+            if (spins < kSpinLimit) {
+                continue;
+            }
+            park([this]() { return !empty() || closed_; });
+        }
+        return true;
+    }
+
+    // Wake both sides; pop() still drains what is left
+    void close() {
+        closed_ = true;
+        std::lock_guard<std::mutex> lock(waitMutex_);
+        waitCV_.notify_all();
+    }
+
+    bool empty() const { return head_.load() == tail_.load(); }
+    bool closed() const { return closed_; }
+
+private:
+    static constexpr int kSpinLimit = 256;
+
+    template <typename Pred>
+    void park(Pred ready) {
+        waiters_.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(waitMutex_);
+            waitCV_.wait(lock, ready);
+        }
+        waiters_.fetch_sub(1);
+    }
+
+    void wakeWaiters() {
+        if (waiters_.load() > 0) {
+            std::lock_guard<std::mutex> lock(waitMutex_);
+            waitCV_.notify_all();
+        }
+    }
+
+    std::vector<T> buffer_;
+    size_t mask_;
+
+    // Producer and consumer indices live on separate cache lines
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+
+    std::atomic<bool> closed_;
+    std::atomic<int> waiters_;
+    std::mutex waitMutex_;
+    std::condition_variable waitCV_;
+};
@@ -0,0 +1,342 @@
+#include "summa.h"
+#include "peer_link.h"
+#include <algorithm>
+#include <chrono>
+
+// How long the grid may take to connect before this client gives up on it
+static const int SUMMA_CONNECT_TIMEOUT_MS = 5000;
+
+// A peer that sends nothing for this long is treated as lost. A step can
+// take a while on a big job, so this is generous.
+static const int SUMMA_STALL_TIMEOUT_MS = 60000;
+
+// What a peer sends right after connecting: the job and its grid rank
+struct PeerHello {
+    int jobId;
+    int rank;
+};
+
+SummaNode::SummaNode(Multiply multiply, Report report)
+    : multiply_(std::move(multiply)), report_(std::move(report)), listenFd_(-1), running_(true), abandon_(false),
+      plan_(), planned_(false), a_(), b_(), haveA_(false), haveB_(false), sendFailed_(false), sending_(false) {}
+
+SummaNode::~SummaNode() {
+    stop();
+}
+
+int SummaNode::listen() {
+    // The master tells our peers which port
+    int port = 0;
+    int fd = listenAnyPort(SOMAXCONN, port);
+    if (fd < 0) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    listenFd_ = fd;
+    return port;
+}
+
+void SummaNode::begin(const SummaPlan& plan) {
+    endJob();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+        return;
+    }
+    plan_ = plan;
+    planned_ = true;
+    haveA_ = haveB_ = false;
+}
+
+void SummaNode::deliver(SummaData piece) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!planned_ || piece.jobId != plan_.jobId || runThread_.joinable()) {
+            return;
+        }
+        if (piece.piece == SUMMA_A) {
+            a_ = std::move(piece);
+            haveA_ = true;
+        } else if (piece.piece == SUMMA_B) {
+            b_ = std::move(piece);
+            haveB_ = true;
+        }
+        if (!haveA_ || !haveB_) {
+            return;
+        }
+    }
+    runThread_ = std::thread(&SummaNode::run, this);
+}
+
+bool SummaNode::connectPeers() {
+    int me = rankOf(plan_.row, plan_.col);
+
+    // Everyone in our grid row and grid column; of each pair, the lower
+    // rank connects and the higher one accepts
+    std::vector<int> accepting;
+    std::vector<int> connecting;
+    for (int c = 0; c < plan_.gridCols; c++) {
+        if (c != plan_.col) {
+            int rank = rankOf(plan_.row, c);
+            (rank < me ? accepting : connecting).push_back(rank);
+        }
+    }
+    for (int r = 0; r < plan_.gridRows; r++) {
+        if (r != plan_.row) {
+            int rank = rankOf(r, plan_.col);
+            (rank < me ? accepting : connecting).push_back(rank);
+        }
+    }
+
+    PeerHello hello = {plan_.jobId, me};
+    for (int rank : connecting) {
+        if (rank >= (int)plan_.peers.size()) {
+            return false;
+        }
+        const auto& [host, port] = plan_.peers[rank];
+        int fd = connectPeer(host, port, &hello, sizeof(hello));
+        if (fd < 0) {
+            std::cerr << "SUMMA: cannot reach peer " << rank << " at " << host << ":" << port << "\n";
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        peerFds_[rank] = fd;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SUMMA_CONNECT_TIMEOUT_MS);
+    size_t accepted = 0;
+    while (accepted < accepting.size()) {
+        int fd = acceptPeer(listenFd_, deadline, [this]() { return active(); });
+        if (fd < 0) {
+            if (active()) {
+                std::cerr << "SUMMA: only " << accepted << " of " << accepting.size() << " peers connected\n";
+            }
+            return false;
+        }
+
+        // A peer still trying for an earlier job may sit in the backlog
+        PeerHello peer;
+        bool expected = receiveHello(fd, &peer, sizeof(peer)) &&
+                        peer.jobId == plan_.jobId &&
+                        std::find(accepting.begin(), accepting.end(), peer.rank) != accepting.end();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!expected || peerFds_.count(peer.rank)) {
+            close(fd);
+            continue;
+        }
+        peerFds_[peer.rank] = fd;
+        accepted++;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [rank, fd] : peerFds_) {
+        setReceiveTimeout(fd, SUMMA_STALL_TIMEOUT_MS);
+    }
+    return active();
+}
+
+bool SummaNode::receivePanel(int rank, int step, int piece, std::vector<double>& panel) {
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = peerFds_.find(rank);
+        if (it == peerFds_.end()) {
+            return false;
+        }
+        fd = it->second;
+    }
+
+    // Each peer sends its panels in step order, so the next one from the
+    // owner is this step's
+    auto [msgType, payload] = NetworkMessage::receiveMessage(fd);
+    if (msgType != SUMMA_PANEL) {
+        return false;
+    }
+    SummaData data = NetworkMessage::deserializeSummaData(payload);
+    if (data.jobId != plan_.jobId || data.step != step || data.piece != piece) {
+        return false;
+    }
+    panel = std::move(data.data);
+    return true;
+}
+
+void SummaNode::sendPanel(const std::vector<int>& ranks, int step, int piece, int rows, int cols,
+                          std::vector<double> panel) {
+    SummaData data = {plan_.jobId, piece, step, rows, cols, std::move(panel)};
+    auto payload = std::make_shared<const std::vector<char>>(NetworkMessage::serializeSummaData(data));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int rank : ranks) {
+        auto it = peerFds_.find(rank);
+        if (it != peerFds_.end()) {
+            outbox_.push_back({it->second, payload});
+        }
+    }
+    outboxReady_.notify_all();
+}
+
+void SummaNode::sendLoop() {
+    while (true) {
+        Outgoing next;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            outboxReady_.wait(lock, [this]() { return !outbox_.empty() || !sending_ || !active(); });
+            if (outbox_.empty() || !active()) {
+                return;
+            }
+            next = outbox_.front();
+            outbox_.pop_front();
+        }
+
+        if (!NetworkMessage::sendMessage(next.fd, SUMMA_PANEL, *next.payload)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sendFailed_ = true;
+            outbox_.clear();
+            return;
+        }
+    }
+}
+
+void SummaNode::run() {
+    const SummaPlan& plan = plan_;
+    int edge = plan.blockSize;
+    int kBlocks = tileCount(edge, plan.k);
+    int localRows = cyclicExtent(plan.m, edge, plan.gridRows, plan.row);
+    int localCols = cyclicExtent(plan.n, edge, plan.gridCols, plan.col);
+
+    std::vector<int> rowPeers, colPeers;
+    for (int c = 0; c < plan.gridCols; c++) {
+        if (c != plan.col) {
+            rowPeers.push_back(rankOf(plan.row, c));
+        }
+    }
+    for (int r = 0; r < plan.gridRows; r++) {
+        if (r != plan.row) {
+            colPeers.push_back(rankOf(r, plan.col));
+        }
+    }
+
+    std::cout << "SUMMA job " << plan.jobId << ": position (" << plan.row << ", " << plan.col << ") of "
+              << plan.gridRows << "x" << plan.gridCols << ", " << localRows << "x" << localCols << " of C\n";
+
+    bool ok = connectPeers();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sendFailed_ = false;
+        sending_ = true;
+    }
+    sendThread_ = std::thread(&SummaNode::sendLoop, this);
+
+    std::vector<double> c((size_t)localRows * localCols, 0.0);
+    std::vector<double> product(c.size());
+    int step = 0;
+    for (; ok && step < kBlocks && active(); step++) {
+        int depthStart = step * edge;
+        int depth = tileEnd(depthStart, edge, plan.k) - depthStart;
+
+        // A's block column `step`, restricted to our grid row's rows
+        std::vector<double> panelA;
+        int ownerA = step % plan.gridCols;
+        if (ownerA == plan.col) {
+            int offset = cyclicOffset(step, edge, plan.gridCols);
+            panelA.resize((size_t)localRows * depth);
+            for (int r = 0; r < localRows; r++) {
+                std::memcpy(&panelA[(size_t)r * depth], &a_.data[(size_t)r * a_.cols + offset], depth * sizeof(double));
+            }
+            sendPanel(rowPeers, step, SUMMA_A, localRows, depth, panelA);
+        } else {
+            ok = receivePanel(rankOf(plan.row, ownerA), step, SUMMA_A, panelA) &&
+                 panelA.size() == (size_t)localRows * depth;
+        }
+
+        // B's block row `step`, restricted to our grid column's columns
+        std::vector<double> panelB;
+        int ownerB = step % plan.gridRows;
+        if (ok && ownerB == plan.row) {
+            size_t offset = (size_t)cyclicOffset(step, edge, plan.gridRows) * b_.cols;
+            panelB.assign(b_.data.begin() + offset, b_.data.begin() + offset + (size_t)depth * localCols);
+            sendPanel(colPeers, step, SUMMA_B, depth, localCols, panelB);
+        } else if (ok) {
+            ok = receivePanel(rankOf(ownerB, plan.col), step, SUMMA_B, panelB) &&
+                 panelB.size() == (size_t)depth * localCols;
+        }
+
+        if (ok) {
+            multiply_(panelA.data(), panelB.data(), localRows, depth, localCols, product.data());
+            for (size_t i = 0; i < c.size(); i++) {
+                c[i] += product[i];
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        ok = ok && !sendFailed_;
+    }
+
+    // Our last panels must reach the peers before the sockets close
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sending_ = false;
+    }
+    outboxReady_.notify_all();
+    sendThread_.join();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ok = ok && !sendFailed_ && step == kBlocks;
+        for (auto& [rank, fd] : peerFds_) {
+            close(fd);
+        }
+        peerFds_.clear();
+    }
+
+    if (!active()) {
+        return;
+    }
+    if (!ok) {
+        std::cerr << "SUMMA job " << plan.jobId << ": gave up at step " << step << " of " << kBlocks << "\n";
+        report_({plan.jobId, SUMMA_C, -1, 0, 0, {}});
+        return;
+    }
+    report_({plan.jobId, SUMMA_C, kBlocks, localRows, localCols, std::move(c)});
+}
+
+void SummaNode::endJob() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abandon_ = true;
+
+        // Wake a run blocked in recv and a sender blocked in send; the
+        // acceptor polls
+        for (auto& [rank, fd] : peerFds_) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    outboxReady_.notify_all();
+
+    if (runThread_.joinable()) {
+        runThread_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    planned_ = false;
+    outbox_.clear();
+    abandon_ = false;
+}
+
+void SummaNode::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        if (listenFd_ >= 0) {
+            shutdown(listenFd_, SHUT_RDWR);
+        }
+    }
+
+    endJob();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (listenFd_ >= 0) {
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+}
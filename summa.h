@@ -0,0 +1,89 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Client side of a SUMMA job (see SummaPlan in common.h).
+//
+// The master sends a plan and this client's pieces of A and B. The node
+// then connects to the peers in its grid row and grid column and steps
+// through the inner dimension one block at a time: it sends the A and B
+// panels it owns for the step, receives the ones it does not, and adds
+// their product to its piece of C, which finally goes back to the master.
+// Panels travel peer to peer; the master sends each operand element once.
+//
+// A peer that cannot be reached or goes quiet ends this client's part. It
+// reports that it gave up, and the master hands its blocks out as ordinary
+// tiles. The listener lives for the whole session.
+class SummaNode {
+public:
+    // out (rows x cols) = a (rows x depth) x b (depth x cols), all row-major
+    using Multiply = std::function<void(const double* a, const double* b, int rows, int depth, int cols, double* out)>;
+
+    // Called from the node's thread with the SUMMA_RESULT to send
+    using Report = std::function<void(const SummaData& result)>;
+
+    SummaNode(Multiply multiply, Report report);
+    ~SummaNode();
+
+    SummaNode(const SummaNode&) = delete;
+    SummaNode& operator=(const SummaNode&) = delete;
+
+    // Open the peer listener; returns its TCP port, or 0 if SUMMA is off
+    int listen();
+
+    // A SUMMA_PLAN arrived: drop any earlier job and wait for its operands
+    void begin(const SummaPlan& plan);
+
+    // A SUMMA_OPERANDS piece arrived; the job runs once A and B are here
+    void deliver(SummaData piece);
+
+    // Abandon the current job, close the listener and join the threads
+    void stop();
+
+private:
+    void run();
+    bool connectPeers();
+    bool receivePanel(int rank, int step, int piece, std::vector<double>& panel);
+    void sendPanel(const std::vector<int>& ranks, int step, int piece, int rows, int cols, std::vector<double> panel);
+    void sendLoop();
+    int rankOf(int row, int col) const { return row * plan_.gridCols + col; }
+    bool active() const { return running_ && !abandon_; }
+
+    // Wake and join the current job's threads, closing its peer sockets
+    void endJob();
+
+    Multiply multiply_;
+    Report report_;
+
+    int listenFd_;
+    std::atomic<bool> running_;
+    std::atomic<bool> abandon_;  // The current job's threads should give up
+
+    std::mutex mutex_;
+    std::condition_variable outboxReady_;
+    SummaPlan plan_;
+    bool planned_;
+    SummaData a_, b_;
+    bool haveA_, haveB_;
+    std::map<int, int> peerFds_;  // <rank, socket>, guarded by mutex_
+
+    // Panels waiting to go out, in step order, so a peer blocked on one
+    // step never waits behind a later one
+    struct Outgoing {
+        int fd;
+        std::shared_ptr<const std::vector<char>> payload;
+    };
+    std::deque<Outgoing> outbox_;  // Guarded by mutex_
+    bool sendFailed_;              // Guarded by mutex_
+    bool sending_;                 // Guarded by mutex_; sendLoop runs
+
+    std::thread runThread_;
+    std::thread sendThread_;
+};
@@ -128,12 +128,21 @@ bool compareMatrices(const Matrix& A, const Matrix& B) {
 // Test bench
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <port> [matrix_size=1000]\n";
+        std::cerr << "Usage: " << argv[0] << " <port> [matrix_size=1000] [jobs=1] [schedule=static|guided|summa] [order=rows|supertile|morton|hilbert] [urgent_size=0]\n";
         return 1;
     }
     int port = std::stoi(argv[1]);
 
     int matrixSize = (argc > 2) ? std::stoi(argv[2]) : 1000;
+    int jobs = (argc > 3) ? std::max(std::stoi(argv[3]), 1) : 1;
+    std::string schedule = (argc > 4) ? argv[4] : "static";
+    TileOrder tileOrder = TILE_ORDER_ROWS;
+    if (argc > 5 && !parseTileOrder(argv[5], tileOrder)) {
+        std::cerr << "Unknown tile order: " << argv[5] << "\n";
+        return 1;
+    }
+    // A small high-priority job submitted while the first one runs
+    int urgentSize = (argc > 6) ? std::stoi(argv[6]) : 0;
     std::cout << "Generating random matrices of size " << matrixSize << "x" << matrixSize << std::endl;
     Matrix A = generateRandomMatrix(matrixSize, matrixSize);
     Matrix B = generateRandomMatrix(matrixSize, matrixSize);
@@ -153,24 +162,56 @@ int main(int argc, char* argv[]) {
     std::cout << "Strassen's algorithm multiplication time: " << elapsed.count() << " seconds\n";
 
     Master master(port);
+    master.setScheduleMode(schedule == "guided" ? SCHEDULE_GUIDED
+                           : schedule == "summa" ? SCHEDULE_SUMMA
+                                                 : SCHEDULE_STATIC);
+    master.setTileOrder(tileOrder);
     master.start();
-    master.setMatrices(A, B);
 
     std::cout << "Press Enter when ready to start computation with the connected clients\n";
     std::cin.get();
-    master.startComputation();
 
     start = std::chrono::high_resolution_clock::now();
-    while (!master.isComplete()) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+    int jobId = master.submitJob(A, B);
+
+    // It overtakes the first job rather than queueing behind it
+    if (urgentSize > 0) {
+        Matrix urgentA = generateRandomMatrix(urgentSize, urgentSize);
+        Matrix urgentB = generateRandomMatrix(urgentSize, urgentSize);
+        auto urgentStart = std::chrono::high_resolution_clock::now();
+        int urgentId = master.submitJob(urgentA, urgentB, 1);
+        master.waitForJob(urgentId);
+        Matrix urgentC = master.takeResult(urgentId);
+        elapsed = std::chrono::high_resolution_clock::now() - urgentStart;
+        std::cout << "Urgent job of size " << urgentSize << " took " << elapsed.count() << " seconds; first job "
+                  << (master.isComplete(jobId) ? "already complete" : "still running") << "\n";
+        assert(compareMatrices(bruteForceMultiplication(urgentA, urgentB), urgentC));
     }
-    auto C_distributed =  master.getResult();
+
+    master.waitForJob(jobId);
+    auto C_distributed = master.takeResult(jobId);
     end = std::chrono::high_resolution_clock::now();
     elapsed = end - start;
     std::cout << "Distributed computation multiplication time: " << elapsed.count() << " seconds\n";
 
     assert(compareMatrices(C_brute, C_strassen));
     assert(compareMatrices(C_brute, C_distributed));
+    
+    // Further jobs reuse the same client connections: multiply the last
+    // product by B again and check each one
+    for (int job = 2; job <= jobs; job++) {
+        Matrix expected = bruteForceMultiplication(C_distributed, B);
+        
+        start = std::chrono::high_resolution_clock::now();
+        jobId = master.submitJob(C_distributed, B);
+        master.waitForJob(jobId);
+        C_distributed = master.takeResult(jobId);
+        end = std::chrono::high_resolution_clock::now();
+        elapsed = end - start;
+        std::cout << "Job " << job << " distributed multiplication time: " << elapsed.count() << " seconds\n";
+        
+        assert(compareMatrices(expected, C_distributed));
+    }
     std::cout << "Matrix multiplication results are correct.\n";
 
     return 0;
@@ -0,0 +1,115 @@
+#include "tile_order.h"
+#include <algorithm>
+
+bool parseTileOrder(const std::string& name, TileOrder& order) {
+    if (name == "rows") {
+        order = TILE_ORDER_ROWS;
+    } else if (name == "supertile") {
+        order = TILE_ORDER_SUPERTILE;
+    } else if (name == "morton") {
+        order = TILE_ORDER_MORTON;
+    } else if (name == "hilbert") {
+        order = TILE_ORDER_HILBERT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* tileOrderName(TileOrder order) {
+    switch (order) {
+    case TILE_ORDER_ROWS:
+        return "rows";
+    case TILE_ORDER_SUPERTILE:
+        return "supertile";
+    case TILE_ORDER_MORTON:
+        return "morton";
+    case TILE_ORDER_HILBERT:
+        return "hilbert";
+    }
+    return "unknown";
+}
+
+// Position `d` along a Z-order curve: even bits give the column, odd bits the row
+static void mortonCell(int d, int& row, int& col) {
+    row = col = 0;
+    for (int bit = 0; d >> (2 * bit); bit++) {
+        col |= ((d >> (2 * bit)) & 1) << bit;
+        row |= ((d >> (2 * bit + 1)) & 1) << bit;
+    }
+}
+
+// Position `d` along a Hilbert curve filling an n x n square (n a power of two)
+static void hilbertCell(int n, int d, int& row, int& col) {
+    row = col = 0;
+    for (int s = 1; s < n; s *= 2) {
+        int rx = 1 & (d / 2);
+        int ry = 1 & (d ^ rx);
+        if (ry == 0) {
+            // Rotate the quadrant so the curve enters and leaves it at the right corners
+            if (rx == 1) {
+                col = s - 1 - col;
+                row = s - 1 - row;
+            }
+            std::swap(col, row);
+        }
+        col += s * rx;
+        row += s * ry;
+        d /= 4;
+    }
+}
+
+std::vector<std::pair<int, int>> enumerateTiles(TileOrder order, int rowTiles, int colTiles) {
+    std::vector<std::pair<int, int>> tiles;
+    tiles.reserve((size_t)rowTiles * colTiles);
+
+    switch (order) {
+    case TILE_ORDER_ROWS:
+        for (int i = 0; i < rowTiles; i++) {
+            for (int j = 0; j < colTiles; j++) {
+                tiles.emplace_back(i, j);
+            }
+        }
+        break;
+
+    case TILE_ORDER_SUPERTILE:
+        for (int bi = 0; bi < rowTiles; bi += SUPERTILE_SIZE) {
+            for (int bj = 0; bj < colTiles; bj += SUPERTILE_SIZE) {
+                for (int i = bi; i < std::min(bi + SUPERTILE_SIZE, rowTiles); i++) {
+                    for (int j = bj; j < std::min(bj + SUPERTILE_SIZE, colTiles); j++) {
+                        tiles.emplace_back(i, j);
+                    }
+                }
+            }
+        }
+        break;
+
+    case TILE_ORDER_MORTON:
+    case TILE_ORDER_HILBERT: {
+        // Walk the curve over the enclosing power-of-two square, skipping
+        // cells outside the grid
+        int n = 1;
+        while (n < std::max(rowTiles, colTiles)) {
+            n *= 2;
+        }
+        for (int d = 0; d < n * n; d++) {
+            int i, j;
+            if (order == TILE_ORDER_MORTON) {
+                mortonCell(d, i, j);
+            } else {
+                hilbertCell(n, d, i, j);
+            }
+            if (i < rowTiles && j < colTiles) {
+                tiles.emplace_back(i, j);
+            }
+        }
+        break;
+    }
+    }
+
+    return tiles;
+}
+
+int walkLength(TileOrder order, int colTiles) {
+    return (order == TILE_ORDER_ROWS) ? std::max(colTiles, 1) : SUPERTILE_SIZE * SUPERTILE_SIZE;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+// Tiles per side of a supertile, and of the blocks Morton and Hilbert
+// walks cover
+#define SUPERTILE_SIZE 4
+
+// Order in which a job's tile grid is enumerated. The sequence is cut into
+// walks, runs of consecutive tiles that one client works through in turn,
+// so the order decides which panels a client gets to reuse.
+enum TileOrder {
+    TILE_ORDER_ROWS,       // Row-major; a walk is one tile row
+    TILE_ORDER_SUPERTILE,  // Row-major blocks of SUPERTILE_SIZE x SUPERTILE_SIZE tiles
+    TILE_ORDER_MORTON,     // Z-order curve
+    TILE_ORDER_HILBERT     // Hilbert curve
+};
+
+// Parse "rows", "supertile", "morton" or "hilbert"; returns false for anything else
+bool parseTileOrder(const std::string& name, TileOrder& order);
+const char* tileOrderName(TileOrder order);
+
+// Every tile of a rowTiles x colTiles grid as (row, column), in `order`
+std::vector<std::pair<int, int>> enumerateTiles(TileOrder order, int rowTiles, int colTiles);
+
+// Tiles per walk: a whole row for row-major, a supertile's worth otherwise
+int walkLength(TileOrder order, int colTiles);
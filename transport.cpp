@@ -0,0 +1,40 @@
+#include "transport.h"
+#include "uring.h"
+
+bool parseIoBackend(const std::string& name, IoBackend& backend) {
+    if (name == "blocking") {
+        backend = IO_BACKEND_BLOCKING;
+    } else if (name == "epoll") {
+        backend = IO_BACKEND_EPOLL;
+    } else if (name == "uring" || name == "io_uring") {
+        backend = IO_BACKEND_URING;
+    } else if (name == "shm") {
+        backend = IO_BACKEND_SHM;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* ioBackendName(IoBackend backend) {
+    switch (backend) {
+        case IO_BACKEND_BLOCKING: return "blocking";
+        case IO_BACKEND_EPOLL: return "epoll";
+        case IO_BACKEND_URING: return "io_uring";
+        case IO_BACKEND_SHM: return "shared memory";
+    }
+    return "unknown";
+}
+
+std::unique_ptr<Transport> Transport::create(int sockfd, IoBackend preferred) {
+    if (preferred == IO_BACKEND_URING) {
+        std::unique_ptr<UringTransport> transport(new UringTransport(sockfd));
+        if (transport->init()) {
+            return std::move(transport);
+        }
+        std::cerr << "io_uring unavailable, falling back to blocking I/O\n";
+    }
+
+    // A single connection gains nothing from epoll; it uses blocking I/O
+    return std::unique_ptr<Transport>(new SocketTransport(sockfd));
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "common.h"
+#include <memory>
+
+// I/O backends selectable at runtime
+enum IoBackend {
+    IO_BACKEND_BLOCKING = 0,  // Blocking send/recv loops
+    IO_BACKEND_EPOLL = 1,     // Non-blocking sockets driven by epoll (master)
+    IO_BACKEND_URING = 2,     // io_uring with registered and provided buffers
+    IO_BACKEND_SHM = 3        // Shared memory when co-located, else blocking (client)
+};
+
+// Parse "blocking", "epoll", "uring" or "shm"; returns false for anything else
+bool parseIoBackend(const std::string& name, IoBackend& backend);
+const char* ioBackendName(IoBackend backend);
+
+// Framed message transport over a connected socket.
+// sendMessage may be called from one thread while another blocks in
+// receiveMessage.
+class Transport {
+public:
+    virtual ~Transport() {}
+
+    virtual bool sendMessage(MessageType type, const std::vector<char>& payload) = 0;
+
+    // Returns CLIENT_DISCONNECT once the connection is closed
+    virtual std::pair<MessageType, std::vector<char>> receiveMessage() = 0;
+
+    virtual IoBackend backend() const = 0;
+
+    // Operands and result matrix shared with the master, if this transport
+    // maps them; tiles written to sharedResult need not be sent back
+    virtual bool sharedOperands(MatrixView& a, MatrixView& b) const { return false; }
+    virtual double* sharedResult(int& cols) const { return nullptr; }
+
+    // The next task belongs to the job announced with this segment name
+    // (JOB_START); map it if this transport shares memory. An empty name
+    // means the job is not shared. Call it from the thread that runs
+    // tasks, between tasks.
+    virtual void switchJob(const std::string& sharedName) {}
+
+    // The job using this segment finished; unmap it. Same thread as switchJob.
+    virtual void releaseJob(const std::string& sharedName) {}
+
+    // Transport for a connected socket using the preferred backend,
+    // falling back to blocking I/O when it is unavailable. Shared memory is
+    // negotiated later (ShmTransport::negotiate) over a blocking transport.
+    static std::unique_ptr<Transport> create(int sockfd, IoBackend preferred);
+};
+
+// Plain blocking send/recv, the NetworkMessage helpers
+class SocketTransport : public Transport {
+public:
+    explicit SocketTransport(int sockfd) : socket_(sockfd) {}
+
+    bool sendMessage(MessageType type, const std::vector<char>& payload) override {
+        return NetworkMessage::sendMessage(socket_, type, payload);
+    }
+
+    std::pair<MessageType, std::vector<char>> receiveMessage() override {
+        return NetworkMessage::receiveMessage(socket_);
+    }
+
+    IoBackend backend() const override { return IO_BACKEND_BLOCKING; }
+
+private:
+    int socket_;
+};
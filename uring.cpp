@@ -0,0 +1,458 @@
+#include "uring.h"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Provided receive buffers per ring and their size
+static const unsigned RECV_BUFFER_COUNT = 64;
+static const unsigned RECV_BUFFER_SIZE = 64 * 1024;
+
+// Initial size of each registered send buffer; grown on demand
+static const size_t SEND_BUFFER_SIZE = 256 * 1024;
+
+// user_data tags for the client transport
+static const uint64_t TAG_RECV = 1;
+static const uint64_t TAG_SEND = 2;
+
+static int ioUringSetup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+IoUring::IoUring()
+    : ringFd_(-1), sqRing_(MAP_FAILED), sqRingSize_(0), sqHead_(nullptr), sqTail_(nullptr),
+      sqMask_(nullptr), sqArray_(nullptr), sqes_(nullptr), sqesSize_(0), sqLocalTail_(0),
+      cqRing_(MAP_FAILED), cqRingSize_(0), cqHead_(nullptr), cqTail_(nullptr), cqMask_(nullptr),
+      cqes_(nullptr), bufRing_(nullptr), bufRingSize_(0), bufGroup_(0), bufCount_(0),
+      bufferSize_(0), bufferPool_(nullptr), bufTail_(0), buffersRegistered_(false) {}
+
+IoUring::~IoUring() {
+    release();
+}
+
+bool IoUring::available() {
+    static const bool usable = []() {
+        IoUring probe;
+        return probe.init(4);
+    }();
+    return usable;
+}
+
+bool IoUring::init(unsigned entries) {
+    // WRITE_FIXED has no MSG_NOSIGNAL; a peer that went away must surface
+    // as -EPIPE in the completion rather than kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ringFd_ = ioUringSetup(entries, &params);
+    if (ringFd_ < 0) {
+        return false;
+    }
+
+    // The single mmap layout is required; every kernel with multishot recv has it
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        release();
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    sqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        release();
+        return false;
+    }
+    cqRing_ = sqRing_;
+
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        release();
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqLocalTail_ = *sqTail_;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+void IoUring::release() {
+    // Closing the ring cancels outstanding requests and drops the buffer
+    // registrations, so the memory behind them can be freed afterwards
+    if (sqes_) {
+        munmap(sqes_, sqesSize_);
+        sqes_ = nullptr;
+    }
+    if (sqRing_ != MAP_FAILED) {
+        munmap(sqRing_, sqRingSize_);
+        sqRing_ = MAP_FAILED;
+        cqRing_ = MAP_FAILED;
+    }
+    if (ringFd_ >= 0) {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+    buffersRegistered_ = false;
+
+    if (bufRing_) {
+        munmap(bufRing_, bufRingSize_);
+        bufRing_ = nullptr;
+    }
+    delete[] bufferPool_;
+    bufferPool_ = nullptr;
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head > *sqMask_) {
+        // Queue full: hand what we have to the kernel first
+        if (submit() < 0) {
+            return nullptr;
+        }
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqLocalTail_ - head > *sqMask_) {
+            return nullptr;
+        }
+    }
+
+    unsigned index = sqLocalTail_ & *sqMask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    sqLocalTail_++;
+    return sqe;
+}
+
+int IoUring::submit(unsigned waitFor) {
+    unsigned toSubmit = sqLocalTail_ - *sqTail_;
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+
+    if (toSubmit == 0 && waitFor == 0) {
+        return 0;
+    }
+
+    while (true) {
+        int ret = ioUringEnter(ringFd_, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        return ret;
+    }
+}
+
+bool IoUring::peekCqe(struct io_uring_cqe& cqe) {
+    unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    cqe = cqes_[head & *cqMask_];
+    return true;
+}
+
+void IoUring::seenCqe() {
+    __atomic_store_n(cqHead_, *cqHead_ + 1, __ATOMIC_RELEASE);
+}
+
+bool IoUring::registerBuffers(const struct iovec* iovs, unsigned count) {
+    if (buffersRegistered_) {
+        unregisterBuffers();
+    }
+    buffersRegistered_ = ioUringRegister(ringFd_, IORING_REGISTER_BUFFERS, iovs, count) == 0;
+    return buffersRegistered_;
+}
+
+void IoUring::unregisterBuffers() {
+    ioUringRegister(ringFd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    buffersRegistered_ = false;
+}
+
+bool IoUring::setupBufferRing(uint16_t group, unsigned count, unsigned size) {
+    // The kernel wants a power-of-two ring of io_uring_buf entries
+    bufRingSize_ = count * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (ioUringRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        munmap(ring, bufRingSize_);
+        return false;
+    }
+
+    bufRing_ = static_cast<struct io_uring_buf*>(ring);
+    bufGroup_ = group;
+    bufCount_ = count;
+    bufferSize_ = size;
+    bufferPool_ = new char[(size_t)count * size];
+    bufTail_ = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        recycleBuffer(i);
+    }
+    return true;
+}
+
+void IoUring::recycleBuffer(uint16_t bufferId) {
+    struct io_uring_buf* buf = &bufRing_[bufTail_ & (bufCount_ - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(providedBuffer(bufferId));
+    buf->len = bufferSize_;
+    buf->bid = bufferId;
+    bufTail_++;
+
+    // The ring tail overlays the reserved field of the first entry
+    struct io_uring_buf_ring* header = reinterpret_cast<struct io_uring_buf_ring*>(bufRing_);
+    __atomic_store_n(&header->tail, bufTail_, __ATOMIC_RELEASE);
+}
+
+void IoUring::prepRecvMultishot(struct io_uring_sqe* sqe, int fd, uint16_t group, uint64_t userData) {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepAcceptMultishot(struct io_uring_sqe* sqe, int fd, uint64_t userData) {
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepSend(struct io_uring_sqe* sqe, int fd, const void* buf, size_t len, uint64_t userData) {
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepWriteFixed(struct io_uring_sqe* sqe, int fd, const void* buf, size_t len,
+                             uint16_t bufIndex, uint64_t userData) {
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->off = (uint64_t)-1;  // Sockets have no file position
+    sqe->buf_index = bufIndex;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepRead(struct io_uring_sqe* sqe, int fd, void* buf, size_t len, uint64_t userData) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepPoll(struct io_uring_sqe* sqe, int fd, unsigned events, uint64_t userData) {
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = userData;
+}
+
+UringTransport::UringTransport(int sockfd)
+    : socket_(sockfd), recvArmed_(false), recvClosed_(false),
+      nextSlot_(0), sendInFlight_(false), inFlightData_(nullptr), inFlightLen_(0), inFlightSlot_(0) {}
+
+UringTransport::~UringTransport() {
+    std::lock_guard<std::mutex> lock(sendMutex_);
+    waitForSend();
+}
+
+bool UringTransport::init() {
+    if (!recvRing_.init(64) || !sendRing_.init(16)) {
+        return false;
+    }
+    if (!recvRing_.setupBufferRing(0, RECV_BUFFER_COUNT, RECV_BUFFER_SIZE)) {
+        return false;
+    }
+    return growSendBuffers(SEND_BUFFER_SIZE) && armReceive();
+}
+
+bool UringTransport::growSendBuffers(size_t size) {
+    struct iovec iovs[2];
+    for (int i = 0; i < 2; i++) {
+        sendBuffers_[i].resize(size);
+        iovs[i].iov_base = sendBuffers_[i].data();
+        iovs[i].iov_len = size;
+    }
+    return sendRing_.registerBuffers(iovs, 2);
+}
+
+bool UringTransport::armReceive() {
+    struct io_uring_sqe* sqe = recvRing_.getSqe();
+    if (!sqe) {
+        return false;
+    }
+    IoUring::prepRecvMultishot(sqe, socket_, 0, TAG_RECV);
+    recvArmed_ = recvRing_.submit() >= 0;
+    return recvArmed_;
+}
+
+std::pair<MessageType, std::vector<char>> UringTransport::receiveMessage() {
+    auto onMessage = [this](MessageType type, std::vector<char>& payload) {
+        received_.emplace_back(type, std::move(payload));
+    };
+
+    while (received_.empty() && !recvClosed_) {
+        if (!recvArmed_ && !armReceive()) {
+            recvClosed_ = true;
+            break;
+        }
+        if (recvRing_.submit(1) < 0) {
+            recvClosed_ = true;
+            break;
+        }
+
+        struct io_uring_cqe cqe;
+        while (recvRing_.peekCqe(cqe)) {
+            recvRing_.seenCqe();
+
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                recvArmed_ = false;  // Multishot ended; rearm on the next pass
+            }
+            if (cqe.res == -ENOBUFS) {
+                continue;  // Ran out of provided buffers; they are back by now
+            }
+            if (cqe.res <= 0) {
+                recvClosed_ = true;  // Peer closed or socket error
+                break;
+            }
+
+            uint16_t bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            reader_.feed(recvRing_.providedBuffer(bufferId), cqe.res, onMessage);
+            recvRing_.recycleBuffer(bufferId);
+        }
+    }
+
+    if (received_.empty()) {
+        return {CLIENT_DISCONNECT, {}};
+    }
+
+    auto message = std::move(received_.front());
+    received_.pop_front();
+    return message;
+}
+
+bool UringTransport::waitForSend() {
+    // Only one write is in flight at a time so short writes can be resumed
+    // without reordering the byte stream
+    while (sendInFlight_) {
+        if (sendRing_.submit(1) < 0) {
+            sendInFlight_ = false;
+            return false;
+        }
+
+        struct io_uring_cqe cqe;
+        while (sendRing_.peekCqe(cqe)) {
+            sendRing_.seenCqe();
+            if (cqe.user_data != TAG_SEND) {
+                continue;
+            }
+            if (cqe.res <= 0) {
+                sendInFlight_ = false;
+                return false;
+            }
+
+            inFlightData_ += cqe.res;
+            inFlightLen_ -= cqe.res;
+            if (inFlightLen_ == 0) {
+                sendInFlight_ = false;
+                break;
+            }
+
+            // Short write: resubmit the rest from the same registered buffer
+            struct io_uring_sqe* sqe = sendRing_.getSqe();
+            if (!sqe) {
+                sendInFlight_ = false;
+                return false;
+            }
+            IoUring::prepWriteFixed(sqe, socket_, inFlightData_, inFlightLen_, inFlightSlot_, TAG_SEND);
+        }
+    }
+    return true;
+}
+
+bool UringTransport::sendMessage(MessageType type, const std::vector<char>& payload) {
+    std::lock_guard<std::mutex> lock(sendMutex_);
+
+    size_t headerSize = sizeof(MessageType) + sizeof(size_t);
+    size_t total = headerSize + payload.size();
+
+    int slot = nextSlot_;
+    if (total > sendBuffers_[slot].size()) {
+        // Re-registering needs both buffers idle
+        if (!waitForSend() || !growSendBuffers(std::max(total, sendBuffers_[slot].size() * 2))) {
+            return false;
+        }
+    }
+
+    // Frame straight into the registered buffer while the other one may
+    // still be on the wire
+    char* ptr = sendBuffers_[slot].data();
+    size_t payloadSize = payload.size();
+    std::memcpy(ptr, &type, sizeof(MessageType));
+    std::memcpy(ptr + sizeof(MessageType), &payloadSize, sizeof(size_t));
+    if (payloadSize > 0) {
+        std::memcpy(ptr + headerSize, payload.data(), payloadSize);
+    }
+
+    if (!waitForSend()) {
+        return false;
+    }
+
+    struct io_uring_sqe* sqe = sendRing_.getSqe();
+    if (!sqe) {
+        return false;
+    }
+    IoUring::prepWriteFixed(sqe, socket_, ptr, total, slot, TAG_SEND);
+    if (sendRing_.submit() < 0) {
+        return false;
+    }
+
+    sendInFlight_ = true;
+    inFlightData_ = ptr;
+    inFlightLen_ = total;
+    inFlightSlot_ = slot;
+    nextSlot_ = 1 - slot;
+    return true;
+}
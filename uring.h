@@ -0,0 +1,129 @@
+#pragma once
+#include "common.h"
+#include "connection.h"
+#include "transport.h"
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <deque>
+#include <mutex>
+
+// Minimal io_uring wrapper built on the raw syscalls (no liburing).
+// One instance must only be driven by one thread at a time.
+class IoUring {
+public:
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Set up the rings; false if io_uring is unavailable (old kernel, seccomp)
+    bool init(unsigned entries);
+
+    // Probe once whether this process can use io_uring at all
+    static bool available();
+
+    // Next free submission entry, zeroed. Submits pending entries first if
+    // the queue is full; nullptr only if that fails.
+    struct io_uring_sqe* getSqe();
+
+    // Submit queued entries and wait for at least `waitFor` completions
+    int submit(unsigned waitFor = 0);
+
+    // Completion queue access: peek the oldest completion, then mark it seen
+    bool peekCqe(struct io_uring_cqe& cqe);
+    void seenCqe();
+
+    // Fixed buffers for IORING_OP_WRITE_FIXED / READ_FIXED
+    bool registerBuffers(const struct iovec* iovs, unsigned count);
+    void unregisterBuffers();
+
+    // Provided buffer ring used by multishot receives
+    bool setupBufferRing(uint16_t group, unsigned count, unsigned size);
+    char* providedBuffer(uint16_t bufferId) { return bufferPool_ + (size_t)bufferId * bufferSize_; }
+    void recycleBuffer(uint16_t bufferId);
+
+    // Submission helpers
+    static void prepRecvMultishot(struct io_uring_sqe* sqe, int fd, uint16_t group, uint64_t userData);
+    static void prepAcceptMultishot(struct io_uring_sqe* sqe, int fd, uint64_t userData);
+    static void prepSend(struct io_uring_sqe* sqe, int fd, const void* buf, size_t len, uint64_t userData);
+    static void prepWriteFixed(struct io_uring_sqe* sqe, int fd, const void* buf, size_t len,
+                               uint16_t bufIndex, uint64_t userData);
+    static void prepRead(struct io_uring_sqe* sqe, int fd, void* buf, size_t len, uint64_t userData);
+    static void prepPoll(struct io_uring_sqe* sqe, int fd, unsigned events, uint64_t userData);
+
+private:
+    void release();
+
+    int ringFd_;
+
+    // Submission queue
+    void* sqRing_;
+    size_t sqRingSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqMask_;
+    unsigned* sqArray_;
+    struct io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    unsigned sqLocalTail_;
+
+    // Completion queue
+    void* cqRing_;
+    size_t cqRingSize_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned* cqMask_;
+    struct io_uring_cqe* cqes_;
+
+    // Provided buffers
+    struct io_uring_buf* bufRing_;
+    size_t bufRingSize_;
+    uint16_t bufGroup_;
+    unsigned bufCount_;
+    unsigned bufferSize_;
+    char* bufferPool_;
+    uint16_t bufTail_;
+
+    bool buffersRegistered_;
+};
+
+// Client-side transport over io_uring. Receives use a multishot recv into a
+// provided buffer ring; sends are copied into registered buffers and written
+// with WRITE_FIXED, double-buffered so serializing the next message overlaps
+// the write of the previous one. Send and receive use separate rings so the
+// sender and receiver threads never share a submission queue.
+class UringTransport : public Transport {
+public:
+    explicit UringTransport(int sockfd);
+    ~UringTransport() override;
+
+    // False if the rings or buffers could not be set up
+    bool init();
+
+    bool sendMessage(MessageType type, const std::vector<char>& payload) override;
+    std::pair<MessageType, std::vector<char>> receiveMessage() override;
+    IoBackend backend() const override { return IO_BACKEND_URING; }
+
+private:
+    bool armReceive();
+    bool waitForSend();
+    bool growSendBuffers(size_t size);
+
+    int socket_;
+
+    IoUring recvRing_;
+    MessageReader reader_;
+    std::deque<std::pair<MessageType, std::vector<char>>> received_;
+    bool recvArmed_;
+    bool recvClosed_;
+
+    std::mutex sendMutex_;
+    IoUring sendRing_;
+    std::vector<char> sendBuffers_[2];
+    int nextSlot_;
+    bool sendInFlight_;
+    const char* inFlightData_;
+    size_t inFlightLen_;
+    int inFlightSlot_;
+};